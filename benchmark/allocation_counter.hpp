@@ -0,0 +1,51 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPROPERTY_ALLOCATION_COUNTER_HPP
+#define XPROPERTY_ALLOCATION_COUNTER_HPP
+
+#include <atomic>
+#include <cstddef>
+
+#include <benchmark/benchmark.h>
+
+namespace xp
+{
+    namespace bench
+    {
+        // Number of calls to the global operator new since the start of the
+        // program, counted by the replacement operators defined in main.cpp.
+
+        std::atomic<std::size_t>& allocation_count() noexcept;
+
+        // Reports the average number of allocations per iteration of a benchmark
+        // since the construction of the counter.
+
+        class allocation_counter
+        {
+        public:
+
+            allocation_counter() noexcept
+                : m_start(allocation_count().load(std::memory_order_relaxed))
+            {
+            }
+
+            void report(benchmark::State& state) const
+            {
+                std::size_t count = allocation_count().load(std::memory_order_relaxed) - m_start;
+                state.counters["allocs_per_op"] = benchmark::Counter(double(count), benchmark::Counter::kAvgIterations);
+            }
+
+        private:
+
+            std::size_t m_start;
+        };
+    }
+}
+
+#endif
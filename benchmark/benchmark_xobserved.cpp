@@ -0,0 +1,334 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "xproperty/xobserved.hpp"
+#include "xproperty/xproperty_lookup.hpp"
+#include "xproperty/xsnapshot.hpp"
+
+#include "allocation_counter.hpp"
+
+namespace xp
+{
+    namespace bench
+    {
+        // Reference owner looking up observers and validators in hash maps
+        // keyed by the property offset, as xobserved used to do.
+
+        template <class D>
+        class map_observed
+        {
+        public:
+
+            template <std::size_t I>
+            void observe(std::function<void(const D&)> cb)
+            {
+                m_observers[I].push_back(std::move(cb));
+            }
+
+        private:
+
+            std::unordered_map<std::size_t, std::vector<std::function<void(const D&)>>> m_observers;
+            std::unordered_map<std::size_t, std::vector<std::function<double(const D&, double)>>> m_validators;
+
+            template <class X, class Y, class Z>
+            friend class ::xp::xproperty;
+
+            template <std::size_t I>
+            void invoke_observers() const
+            {
+                auto position = m_observers.find(I);
+                if (position != m_observers.end())
+                {
+                    for (const auto& cb : position->second)
+                    {
+                        cb(*static_cast<const D*>(this));
+                    }
+                }
+            }
+
+            template <std::size_t I, class V>
+            auto invoke_validators(V&& v) const
+            {
+                auto position = m_validators.find(I);
+                if (position != m_validators.end())
+                {
+                    for (const auto& cb : position->second)
+                    {
+                        v = cb(*static_cast<const D*>(this), v);
+                    }
+                }
+                return v;
+            }
+        };
+
+        struct map_foo : map_observed<map_foo>
+        {
+            XPROPERTY(double, map_foo, bar);
+            XPROPERTY(double, map_foo, baz);
+        };
+
+        struct flat_foo : xobserved<flat_foo>
+        {
+            XPROPERTY(double, flat_foo, bar);
+            XPROPERTY(double, flat_foo, baz);
+        };
+
+        template <class F>
+        void assign_unobserved(benchmark::State& state)
+        {
+            F foo;
+            double value = 0.;
+            for (auto _ : state)
+            {
+                foo.bar = value;
+                value += 1.;
+                benchmark::DoNotOptimize(foo);
+            }
+        }
+
+        template <class F>
+        void assign_other_observed(benchmark::State& state)
+        {
+            F foo;
+            foo.template observe<xoffsetof(F, baz)>([](const F& f) { benchmark::DoNotOptimize(f); });
+            double value = 0.;
+            for (auto _ : state)
+            {
+                foo.bar = value;
+                value += 1.;
+                benchmark::DoNotOptimize(foo);
+            }
+        }
+
+        template <class F>
+        void assign_observed(benchmark::State& state)
+        {
+            F foo;
+            foo.template observe<xoffsetof(F, bar)>([](const F& f) { benchmark::DoNotOptimize(f); });
+            double value = 0.;
+            for (auto _ : state)
+            {
+                foo.bar = value;
+                value += 1.;
+                benchmark::DoNotOptimize(foo);
+            }
+        }
+
+        struct plain_foo
+        {
+            double bar;
+            double baz;
+        };
+
+        // Construction of many unobserved objects, reporting the size of an instance
+
+        template <class F>
+        void construct_unobserved(benchmark::State& state)
+        {
+            for (auto _ : state)
+            {
+                std::vector<F> objects(std::size_t(state.range(0)));
+                benchmark::DoNotOptimize(objects.data());
+            }
+            state.counters["bytes_per_object"] = double(sizeof(F));
+            state.SetItemsProcessed(state.iterations() * state.range(0));
+        }
+
+        BENCHMARK_TEMPLATE(construct_unobserved, plain_foo)->Arg(100000);
+        BENCHMARK_TEMPLATE(construct_unobserved, map_foo)->Arg(100000);
+        BENCHMARK_TEMPLATE(construct_unobserved, flat_foo)->Arg(100000);
+
+        BENCHMARK_TEMPLATE(assign_unobserved, map_foo);
+        BENCHMARK_TEMPLATE(assign_unobserved, flat_foo);
+        BENCHMARK_TEMPLATE(assign_other_observed, map_foo);
+        BENCHMARK_TEMPLATE(assign_other_observed, flat_foo);
+        BENCHMARK_TEMPLATE(assign_observed, map_foo);
+        BENCHMARK_TEMPLATE(assign_observed, flat_foo);
+
+        // Assignment of a property with range(0) observers
+
+        void assign_observers(benchmark::State& state)
+        {
+            flat_foo foo;
+            for (int64_t i = 0; i < state.range(0); ++i)
+            {
+                XOBSERVE(foo, bar, [](const flat_foo& f) { benchmark::DoNotOptimize(f); });
+            }
+            double value = 0.;
+            allocation_counter counter;
+            for (auto _ : state)
+            {
+                foo.bar = value;
+                value += 1.;
+                benchmark::DoNotOptimize(foo);
+            }
+            counter.report(state);
+        }
+
+        BENCHMARK(assign_observers)->Arg(0)->Arg(1)->Arg(4)->Arg(16);
+
+        // Assignment of a property with a chain of range(0) validators
+
+        void assign_validators(benchmark::State& state)
+        {
+            flat_foo foo;
+            for (int64_t i = 0; i < state.range(0); ++i)
+            {
+                XVALIDATE(foo, bar, [](const flat_foo&, double proposal) { return proposal < 0. ? 0. : proposal; });
+            }
+            double value = 0.;
+            allocation_counter counter;
+            for (auto _ : state)
+            {
+                foo.bar = value;
+                value += 1.;
+                benchmark::DoNotOptimize(foo);
+            }
+            counter.report(state);
+        }
+
+        BENCHMARK(assign_validators)->Arg(0)->Arg(1)->Arg(4)->Arg(16);
+
+        // Assignment of a property propagated to another object through XDLINK
+
+        void assign_dlink(benchmark::State& state)
+        {
+            flat_foo source, target;
+            XDLINK(source, bar, target, baz);
+            double value = 0.;
+            allocation_counter counter;
+            for (auto _ : state)
+            {
+                source.bar = value;
+                value += 1.;
+                benchmark::DoNotOptimize(target);
+            }
+            counter.report(state);
+        }
+
+        BENCHMARK(assign_dlink);
+
+        // Registration of an observer on a new object, including the allocation
+        // of the side table
+
+        void register_observer(benchmark::State& state)
+        {
+            allocation_counter counter;
+            for (auto _ : state)
+            {
+                flat_foo foo;
+                XOBSERVE(foo, bar, [&foo](const flat_foo&) { benchmark::DoNotOptimize(foo); });
+                benchmark::DoNotOptimize(foo);
+            }
+            counter.report(state);
+        }
+
+        BENCHMARK(register_observer);
+
+        // Connection and disconnection of a scoped observer
+
+        void connect_observer(benchmark::State& state)
+        {
+            flat_foo foo;
+            XOBSERVE(foo, baz, [](const flat_foo&) {});
+            allocation_counter counter;
+            for (auto _ : state)
+            {
+                xp::connection c = XCONNECT(foo, bar, [&foo](const flat_foo&) { benchmark::DoNotOptimize(foo); });
+                benchmark::DoNotOptimize(c);
+            }
+            counter.report(state);
+        }
+
+        BENCHMARK(connect_observer);
+
+        // Assignment of properties by name, through a hand-built hash map and through
+        // the compile-time perfect hash table
+
+        void set_by_name_map(benchmark::State& state)
+        {
+            using setter_type = void (*)(flat_foo&, double);
+            std::unordered_map<std::string, setter_type> setters = {
+                { "bar", [](flat_foo& f, double v) { f.bar = v; } },
+                { "baz", [](flat_foo& f, double v) { f.baz = v; } }
+            };
+            flat_foo foo;
+            const char* names[] = { "bar", "baz" };
+            double value = 0.;
+            for (auto _ : state)
+            {
+                setters.find(names[std::size_t(value) & 1])->second(foo, value);
+                value += 1.;
+                benchmark::DoNotOptimize(foo);
+            }
+        }
+
+        BENCHMARK(set_by_name_map);
+
+        void set_by_name_perfect_hash(benchmark::State& state)
+        {
+            flat_foo foo;
+            const char* names[] = { "bar", "baz" };
+            double value = 0.;
+            for (auto _ : state)
+            {
+                xp::set_by_name(foo, names[std::size_t(value) & 1], value);
+                value += 1.;
+                benchmark::DoNotOptimize(foo);
+            }
+        }
+
+        BENCHMARK(set_by_name_perfect_hash);
+
+        // Checkpoint and rollback of an observed object, through its copy, which also
+        // copies the callbacks, and through a snapshot
+
+        void checkpoint_copy(benchmark::State& state)
+        {
+            flat_foo foo;
+            XOBSERVE(foo, bar, [](const flat_foo& f) { benchmark::DoNotOptimize(f); });
+            allocation_counter counter;
+            for (auto _ : state)
+            {
+                flat_foo checkpoint = foo;
+                foo.baz = 1.;
+                foo = checkpoint;
+                benchmark::DoNotOptimize(foo);
+            }
+            counter.report(state);
+        }
+
+        BENCHMARK(checkpoint_copy);
+
+        void checkpoint_snapshot(benchmark::State& state)
+        {
+            flat_foo foo;
+            XOBSERVE(foo, bar, [](const flat_foo& f) { benchmark::DoNotOptimize(f); });
+            xp::xsnapshot<flat_foo> checkpoint(foo);
+            allocation_counter counter;
+            for (auto _ : state)
+            {
+                checkpoint.capture(foo);
+                foo.baz = 1.;
+                checkpoint.restore(foo, false);
+                benchmark::DoNotOptimize(foo);
+            }
+            counter.report(state);
+        }
+
+        BENCHMARK(checkpoint_snapshot);
+    }
+}
@@ -0,0 +1,90 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include "xproperty/xobserved.hpp"
+#include "xproperty/xproperty.hpp"
+
+#include "allocation_counter.hpp"
+
+namespace xp
+{
+    namespace bench
+    {
+        struct raw_foo
+        {
+            double bar;
+        };
+
+        struct static_foo
+        {
+            MAKE_OBSERVED()
+
+            XPROPERTY(double, static_foo, bar);
+        };
+
+        struct static_observed_foo
+        {
+            MAKE_OBSERVED()
+
+            XPROPERTY(double, static_observed_foo, bar);
+        };
+
+        XVALIDATE_STATIC(double, static_observed_foo, bar, proposal)
+        {
+            return proposal < 0. ? 0. : proposal;
+        }
+
+        XOBSERVE_STATIC(double, static_observed_foo, bar)
+        {
+            benchmark::DoNotOptimize(bar);
+        }
+
+        struct hybrid_observed_foo : xobserved<hybrid_observed_foo>
+        {
+            MAKE_HYBRID_OBSERVED()
+
+            XPROPERTY(double, hybrid_observed_foo, bar);
+        };
+
+        XVALIDATE_STATIC(double, hybrid_observed_foo, bar, proposal)
+        {
+            return proposal < 0. ? 0. : proposal;
+        }
+
+        XOBSERVE_STATIC(double, hybrid_observed_foo, bar)
+        {
+            benchmark::DoNotOptimize(bar);
+        }
+
+        // Cost of `foo.bar = x` without observer nor validator, and with the
+        // static observer and validator of MAKE_OBSERVED structures, and of
+        // xobserved structures without dynamic callbacks.
+
+        template <class F>
+        void assign_static(benchmark::State& state)
+        {
+            F foo;
+            double value = 0.;
+            allocation_counter counter;
+            for (auto _ : state)
+            {
+                foo.bar = value;
+                value += 1.;
+                benchmark::DoNotOptimize(foo);
+            }
+            counter.report(state);
+        }
+
+        BENCHMARK_TEMPLATE(assign_static, raw_foo);
+        BENCHMARK_TEMPLATE(assign_static, static_foo);
+        BENCHMARK_TEMPLATE(assign_static, static_observed_foo);
+        BENCHMARK_TEMPLATE(assign_static, hybrid_observed_foo);
+    }
+}
@@ -0,0 +1,65 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include <cstdlib>
+#include <new>
+
+#include <benchmark/benchmark.h>
+
+#include "allocation_counter.hpp"
+
+namespace xp
+{
+    namespace bench
+    {
+        std::atomic<std::size_t>& allocation_count() noexcept
+        {
+            static std::atomic<std::size_t> count(0);
+            return count;
+        }
+    }
+}
+
+// Replacement of the global allocation functions, counting the allocations
+
+void* operator new(std::size_t size)
+{
+    xp::bench::allocation_count().fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+BENCHMARK_MAIN();
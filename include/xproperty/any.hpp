@@ -13,6 +13,9 @@
 // Distributed under the Boost Software License, Version 1.0. (See accompanying
 // file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
 //
+// Deprecated: xproperty no longer uses linb::any. This header is kept for the code
+// which includes it, and will be removed in a future release.
+//
 #ifndef LINB_ANY_HPP
 #define LINB_ANY_HPP
 #pragma once
@@ -0,0 +1,263 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XATOMIC_PROPERTY_HPP
+#define XATOMIC_PROPERTY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include "xproperty.hpp"
+
+namespace xp
+{
+
+    /********************************
+     * xatomic_property declaration *
+     ********************************/
+
+    // Type, Owner Type, Derived Type
+    //
+    // Property storing a std::atomic<T>, which can be read and written concurrently.
+    // Values are returned by copy. Assignments and `store` go through the validators,
+    // then notify the observers. The read-modify-write operations do not run the
+    // validators, and notify the observers when they modify the value.
+    //
+    // Notifying only reads the callbacks of the owner, so concurrent operations are
+    // race-free as long as no callback is registered or removed meanwhile. The
+    // observers run on the modifying thread. Notifications are never held.
+
+    template <class T, class O, class D>
+    class xatomic_property
+    {
+    public:
+
+        static_assert(std::is_trivially_copyable<T>::value, "atomic properties require a trivially copyable type");
+
+        using owner_type = O;
+        using derived_type = D;
+
+        using value_type = T;
+        using const_reference = T;
+
+        xatomic_property() noexcept;
+        xatomic_property(value_type value) noexcept;
+
+        // Copies do not notify the observers.
+        xatomic_property(const xatomic_property& rhs) noexcept;
+        xatomic_property& operator=(const xatomic_property& rhs) noexcept;
+
+        operator value_type() const noexcept;
+
+        template <class V>
+        value_type operator=(V&& value);
+
+        value_type load(std::memory_order order = std::memory_order_acquire) const noexcept;
+
+        template <class V>
+        void store(V&& value, std::memory_order order = std::memory_order_release);
+
+        value_type fetch_add(value_type arg, std::memory_order order = std::memory_order_acq_rel);
+        value_type fetch_sub(value_type arg, std::memory_order order = std::memory_order_acq_rel);
+
+        bool compare_exchange_weak(value_type& expected, value_type desired,
+                                   std::memory_order success = std::memory_order_acq_rel,
+                                   std::memory_order failure = std::memory_order_acquire);
+        bool compare_exchange_strong(value_type& expected, value_type desired,
+                                     std::memory_order success = std::memory_order_acq_rel,
+                                     std::memory_order failure = std::memory_order_acquire);
+
+    private:
+
+        owner_type* owner() noexcept;
+
+        // Notifies the observers with the value stored by this thread.
+        void notify(value_type old_value, value_type new_value, std::false_type);
+        void notify(value_type old_value, value_type new_value, std::true_type);
+
+        void exchange(value_type value, std::memory_order order, std::false_type);
+        void exchange(value_type value, std::memory_order order, std::true_type);
+
+        // Swaps the values without validation nor notification.
+        void exchange_value(value_type& value) noexcept;
+
+        std::atomic<value_type> m_value;
+
+        friend struct detail::xproperty_access;
+    };
+
+    /**************************
+     * XPROPERTY_ATOMIC macro *
+     **************************/
+
+    // XPROPERTY_ATOMIC(Type, Owner, Name)
+    //
+    // Defines an atomic property of the specified trivially copyable type and name,
+    // for the specified owner type.
+
+    #define XPROPERTY_ATOMIC(T, O, D) XPROPERTY_DECLARE(::xp::xatomic_property, T, O, D, void)
+
+    /***********************************
+     * xatomic_property implementation *
+     ***********************************/
+
+    template <class T, class O, class D>
+    inline xatomic_property<T, O, D>::xatomic_property() noexcept
+        : m_value(value_type())
+    {
+    }
+
+    template <class T, class O, class D>
+    inline xatomic_property<T, O, D>::xatomic_property(value_type value) noexcept
+        : m_value(value)
+    {
+    }
+
+    template <class T, class O, class D>
+    inline xatomic_property<T, O, D>::xatomic_property(const xatomic_property& rhs) noexcept
+        : m_value(rhs.load(std::memory_order_relaxed))
+    {
+    }
+
+    template <class T, class O, class D>
+    inline auto xatomic_property<T, O, D>::operator=(const xatomic_property& rhs) noexcept -> xatomic_property&
+    {
+        m_value.store(rhs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+
+    template <class T, class O, class D>
+    inline xatomic_property<T, O, D>::operator value_type() const noexcept
+    {
+        return load();
+    }
+
+    template <class T, class O, class D>
+    template <class V>
+    inline auto xatomic_property<T, O, D>::operator=(V&& value) -> value_type
+    {
+        value_type proposal = owner()->template invoke_validators<derived_type::offset(), value_type>(detail::as_proposal<value_type>(std::forward<V>(value)));
+        exchange(proposal, std::memory_order_release, detail::provides_old_value<owner_type, derived_type::offset()>());
+        return proposal;
+    }
+
+    template <class T, class O, class D>
+    inline auto xatomic_property<T, O, D>::load(std::memory_order order) const noexcept -> value_type
+    {
+        return m_value.load(order);
+    }
+
+    template <class T, class O, class D>
+    template <class V>
+    inline void xatomic_property<T, O, D>::store(V&& value, std::memory_order order)
+    {
+        exchange(owner()->template invoke_validators<derived_type::offset(), value_type>(detail::as_proposal<value_type>(std::forward<V>(value))),
+                 order, detail::provides_old_value<owner_type, derived_type::offset()>());
+    }
+
+    template <class T, class O, class D>
+    inline auto xatomic_property<T, O, D>::fetch_add(value_type arg, std::memory_order order) -> value_type
+    {
+        value_type old_value = m_value.fetch_add(arg, order);
+        notify(old_value, static_cast<value_type>(old_value + arg), detail::provides_old_value<owner_type, derived_type::offset()>());
+        return old_value;
+    }
+
+    template <class T, class O, class D>
+    inline auto xatomic_property<T, O, D>::fetch_sub(value_type arg, std::memory_order order) -> value_type
+    {
+        value_type old_value = m_value.fetch_sub(arg, order);
+        notify(old_value, static_cast<value_type>(old_value - arg), detail::provides_old_value<owner_type, derived_type::offset()>());
+        return old_value;
+    }
+
+    template <class T, class O, class D>
+    inline bool xatomic_property<T, O, D>::compare_exchange_weak(value_type& expected, value_type desired,
+                                                                 std::memory_order success, std::memory_order failure)
+    {
+        bool res = m_value.compare_exchange_weak(expected, desired, success, failure);
+        if (res)
+        {
+            notify(expected, desired, detail::provides_old_value<owner_type, derived_type::offset()>());
+        }
+        return res;
+    }
+
+    template <class T, class O, class D>
+    inline bool xatomic_property<T, O, D>::compare_exchange_strong(value_type& expected, value_type desired,
+                                                                   std::memory_order success, std::memory_order failure)
+    {
+        bool res = m_value.compare_exchange_strong(expected, desired, success, failure);
+        if (res)
+        {
+            notify(expected, desired, detail::provides_old_value<owner_type, derived_type::offset()>());
+        }
+        return res;
+    }
+
+    template <class T, class O, class D>
+    inline auto xatomic_property<T, O, D>::owner() noexcept -> owner_type*
+    {
+        return reinterpret_cast<owner_type*>(reinterpret_cast<char*>(this) - derived_type::offset());
+    }
+
+    template <class T, class O, class D>
+    inline void xatomic_property<T, O, D>::notify(value_type, value_type, std::false_type)
+    {
+        owner()->template invoke_observers<derived_type::offset()>();
+    }
+
+    template <class T, class O, class D>
+    inline void xatomic_property<T, O, D>::notify(value_type old_value, value_type new_value, std::true_type)
+    {
+        owner_type* o = owner();
+        if (o->template requires_old_value<derived_type::offset()>())
+        {
+            o->template invoke_atomic_observers<derived_type::offset()>(old_value, new_value);
+        }
+        else
+        {
+            o->template invoke_atomic_observers<derived_type::offset()>(new_value);
+        }
+    }
+
+    template <class T, class O, class D>
+    inline void xatomic_property<T, O, D>::exchange(value_type value, std::memory_order order, std::false_type)
+    {
+        m_value.store(value, order);
+        owner()->template invoke_observers<derived_type::offset()>();
+    }
+
+    // The store only becomes a read-modify-write when an observer needs the previous value.
+
+    template <class T, class O, class D>
+    inline void xatomic_property<T, O, D>::exchange(value_type value, std::memory_order order, std::true_type)
+    {
+        owner_type* o = owner();
+        if (o->template requires_old_value<derived_type::offset()>())
+        {
+            value_type old_value = m_value.exchange(value, order);
+            o->template invoke_atomic_observers<derived_type::offset()>(old_value, value);
+        }
+        else
+        {
+            m_value.store(value, order);
+            o->template invoke_atomic_observers<derived_type::offset()>(value);
+        }
+    }
+
+    template <class T, class O, class D>
+    inline void xatomic_property<T, O, D>::exchange_value(value_type& value) noexcept
+    {
+        value = m_value.exchange(value, std::memory_order_acq_rel);
+    }
+}
+
+#endif
@@ -0,0 +1,711 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XCONNECTION_HPP
+#define XCONNECTION_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "xproperty_config.hpp"
+
+#include "xinplace_function.hpp"
+
+namespace xp
+{
+    template <class D>
+    class xobserved;
+
+    namespace detail
+    {
+        class xobserver_list;
+        class xobserver_pool;
+
+        /******************
+         * xobserver_node *
+         ******************/
+
+        // Node of an intrusive, circular, doubly linked list of observers. A node is
+        // either owned by the list and allocated from the pool of its table (observers
+        // registered with `observe`), or by an `xp::connection`. Linked nodes keep a
+        // pointer to their list, which counts the nodes whose callback needs the
+        // previous value, and moves the invocations in progress past unlinked nodes.
+        // Callbacks receive the owner and, when the previous value of the property
+        // is available, a pointer to the corresponding `xp::change`.
+
+        struct xobserver_link
+        {
+            xobserver_link* p_prev = nullptr;
+            xobserver_link* p_next = nullptr;
+        };
+
+        struct xobserver_node : xobserver_link
+        {
+            using callback_type = xinplace_function<void(const void*, const void*)>;
+
+            xobserver_node() = default;
+
+            template <class C>
+            xobserver_node(C&& cb, xobserver_pool* pool, bool needs_old = false);
+
+            bool linked() const noexcept;
+            void unlink() noexcept;
+            void replace(xobserver_node& rhs) noexcept;
+
+            callback_type m_callback;
+            xobserver_list* p_list = nullptr;
+            // Pool of the owned nodes, null for the nodes of connections.
+            xobserver_pool* p_pool = nullptr;
+            bool m_needs_old = false;
+        };
+
+        /******************
+         * xobserver_pool *
+         ******************/
+
+        // Storage of the nodes owned by the observer lists of a table. The first
+        // XPROPERTY_INLINE_OBSERVERS nodes are stored in the pool itself, so that
+        // registering a few observers does not allocate; the next ones are allocated
+        // on the heap. Copying a pool does not copy its nodes.
+
+        class xobserver_pool
+        {
+        public:
+
+            xobserver_pool() noexcept = default;
+
+            xobserver_pool(const xobserver_pool&) noexcept;
+            xobserver_pool& operator=(const xobserver_pool&) noexcept;
+
+            template <class C>
+            xobserver_node* create(C&& cb, bool needs_old);
+
+            void destroy(xobserver_node* node) noexcept;
+
+        private:
+
+            static_assert(XPROPERTY_INLINE_OBSERVERS <= 64, "the inline nodes of an xobserver_pool are tracked in a 64-bit mask");
+
+            using storage_type = std::aligned_storage_t<sizeof(xobserver_node), alignof(xobserver_node)>;
+
+            std::array<storage_type, XPROPERTY_INLINE_OBSERVERS> m_storage;
+            std::uint64_t m_used = 0;
+        };
+
+        /*************
+         * xdeferred *
+         *************/
+
+        // Task deferred by an observer until the invocation of the observers returns,
+        // for instance the resumption of a coroutine holding the observer.
+
+        struct xdeferred
+        {
+            void (*p_run)(void*) = nullptr;
+            void* p_arg = nullptr;
+            xdeferred* p_next = nullptr;
+        };
+
+        /******************
+         * xobserver_list *
+         ******************/
+
+        class xobserver_list
+        {
+        public:
+
+            xobserver_list() noexcept;
+            ~xobserver_list();
+
+            xobserver_list(const xobserver_list&) = delete;
+            xobserver_list& operator=(const xobserver_list&) = delete;
+
+            xobserver_list(xobserver_list&& rhs) noexcept;
+            xobserver_list& operator=(xobserver_list&& rhs) noexcept;
+
+            bool empty() const noexcept;
+            bool requires_old_value() const noexcept;
+
+            void push_back(xobserver_node& node) noexcept;
+
+            template <class C>
+            void emplace_back(C&& cb, xobserver_pool& pool, bool needs_old = false);
+
+            // Replaces the observers of the list with copies of the observers owned by
+            // rhs, allocated from the pool.
+            void assign(const xobserver_list& rhs, xobserver_pool& pool);
+
+            void clear() noexcept;
+
+            void invoke(const void* owner, const void* change = nullptr);
+
+            // Runs the task when the outermost invocation in progress in the calling
+            // thread returns, or right away when there is none. Tasks run in the order
+            // in which they are deferred. The task must outlive its run, or be
+            // cancelled.
+            static void defer(xdeferred& task);
+            static void cancel(xdeferred& task) noexcept;
+
+        private:
+
+            class iteration;
+
+            struct thread_state
+            {
+                iteration* p_innermost = nullptr;
+                xdeferred* p_head = nullptr;
+                xdeferred* p_tail = nullptr;
+            };
+
+            static thread_state& local() noexcept;
+            static void run_deferred();
+
+            bool invoking() const noexcept;
+            void steal(xobserver_list& rhs) noexcept;
+            void skip(const xobserver_link* link) noexcept;
+            void substitute(const xobserver_link* link, xobserver_link* by) noexcept;
+            void destroy_retired() noexcept;
+
+            xobserver_link m_sentinel;
+            std::size_t m_old_value_count;
+            // Owned nodes removed during an invocation, destroyed when the outermost
+            // invocation of the list returns.
+            xobserver_link* p_retired;
+
+            friend struct xobserver_node;
+        };
+    }
+
+    /**************
+     * connection *
+     **************/
+
+    // Move-only handle on an observer registered with `xobserved::connect`.
+    // The observer node is stored in the connection itself and is unlinked
+    // when the connection is destroyed or disconnected.
+
+    class connection
+    {
+    public:
+
+        connection() = default;
+        ~connection();
+
+        connection(const connection&) = delete;
+        connection& operator=(const connection&) = delete;
+
+        connection(connection&& rhs) noexcept;
+        connection& operator=(connection&& rhs) noexcept;
+
+        bool connected() const noexcept;
+        void disconnect() noexcept;
+
+    private:
+
+        template <class C>
+        connection(C&& cb, bool needs_old);
+
+        detail::xobserver_node m_node;
+
+        template <class D>
+        friend class xobserved;
+    };
+
+    /*********************************
+     * xobserver_node implementation *
+     *********************************/
+
+    namespace detail
+    {
+        template <class C>
+        inline xobserver_node::xobserver_node(C&& cb, xobserver_pool* pool, bool needs_old)
+            : m_callback(std::forward<C>(cb)), p_pool(pool), m_needs_old(needs_old)
+        {
+        }
+
+        inline bool xobserver_node::linked() const noexcept
+        {
+            return p_next != nullptr;
+        }
+
+        inline void xobserver_node::unlink() noexcept
+        {
+            if (linked())
+            {
+                p_list->skip(this);
+                p_prev->p_next = p_next;
+                p_next->p_prev = p_prev;
+                p_prev = nullptr;
+                p_next = nullptr;
+                if (m_needs_old)
+                {
+                    --p_list->m_old_value_count;
+                }
+                p_list = nullptr;
+            }
+        }
+
+        // Takes the place of rhs in its list, if any.
+        inline void xobserver_node::replace(xobserver_node& rhs) noexcept
+        {
+            m_callback = std::move(rhs.m_callback);
+            m_needs_old = rhs.m_needs_old;
+            if (rhs.linked())
+            {
+                rhs.p_list->substitute(&rhs, this);
+                p_prev = rhs.p_prev;
+                p_next = rhs.p_next;
+                p_list = rhs.p_list;
+                p_prev->p_next = this;
+                p_next->p_prev = this;
+                rhs.p_prev = nullptr;
+                rhs.p_next = nullptr;
+                rhs.p_list = nullptr;
+            }
+        }
+
+        /*********************************
+         * xobserver_pool implementation *
+         *********************************/
+
+        inline xobserver_pool::xobserver_pool(const xobserver_pool&) noexcept
+        {
+        }
+
+        inline xobserver_pool& xobserver_pool::operator=(const xobserver_pool&) noexcept
+        {
+            return *this;
+        }
+
+        template <class C>
+        inline xobserver_node* xobserver_pool::create(C&& cb, bool needs_old)
+        {
+            for (std::size_t i = 0; i < m_storage.size(); ++i)
+            {
+                if ((m_used & (std::uint64_t(1) << i)) == 0)
+                {
+                    xobserver_node* node = new (&m_storage[i]) xobserver_node(std::forward<C>(cb), this, needs_old);
+                    m_used |= std::uint64_t(1) << i;
+                    return node;
+                }
+            }
+            return new xobserver_node(std::forward<C>(cb), this, needs_old);
+        }
+
+        inline void xobserver_pool::destroy(xobserver_node* node) noexcept
+        {
+            const storage_type* storage = reinterpret_cast<const storage_type*>(node);
+            std::less<const storage_type*> less;
+            if (!less(storage, m_storage.data()) && less(storage, m_storage.data() + m_storage.size()))
+            {
+                node->~xobserver_node();
+                m_used &= ~(std::uint64_t(1) << (storage - m_storage.data()));
+            }
+            else
+            {
+                delete node;
+            }
+        }
+
+        /*********************************
+         * xobserver_list implementation *
+         *********************************/
+
+        // Invocation of the observers of a list, registered so that unlinking a node
+        // moves the invocation past it. Observers can therefore unlink any node,
+        // including the next ones, or clear the list, while being invoked. Observers
+        // appended meanwhile are not invoked.
+        //
+        // The invocations in progress are kept in a stack per thread, so that invoking
+        // a list only reads it, and several threads can invoke the same list, as long
+        // as no thread modifies it meanwhile.
+
+        class xobserver_list::iteration
+        {
+        public:
+
+            explicit iteration(xobserver_list& list) noexcept;
+            ~iteration();
+
+            iteration(const iteration&) = delete;
+            iteration& operator=(const iteration&) = delete;
+
+            xobserver_node* next() noexcept;
+
+            // Innermost invocation in progress in the calling thread.
+            static iteration*& innermost() noexcept;
+
+        private:
+
+            xobserver_list& m_list;
+            iteration* p_outer;
+            // Next node to invoke, and last node of the invocation.
+            xobserver_link* p_next;
+            xobserver_link* p_last;
+
+            friend class xobserver_list;
+        };
+
+        inline xobserver_list::iteration::iteration(xobserver_list& list) noexcept
+            : m_list(list), p_outer(innermost()), p_next(list.m_sentinel.p_next), p_last(list.m_sentinel.p_prev)
+        {
+            innermost() = this;
+        }
+
+        inline xobserver_list::iteration::~iteration()
+        {
+            innermost() = p_outer;
+            if (m_list.p_retired != nullptr && !m_list.invoking())
+            {
+                m_list.destroy_retired();
+            }
+        }
+
+        inline xobserver_node* xobserver_list::iteration::next() noexcept
+        {
+            xobserver_link* link = p_next;
+            if (link == &m_list.m_sentinel)
+            {
+                return nullptr;
+            }
+            p_next = link == p_last ? &m_list.m_sentinel : link->p_next;
+            return static_cast<xobserver_node*>(link);
+        }
+
+        inline auto xobserver_list::iteration::innermost() noexcept -> iteration*&
+        {
+            return local().p_innermost;
+        }
+
+        inline xobserver_list::xobserver_list() noexcept
+            : m_old_value_count(0), p_retired(nullptr)
+        {
+            m_sentinel.p_prev = &m_sentinel;
+            m_sentinel.p_next = &m_sentinel;
+        }
+
+        inline xobserver_list::~xobserver_list()
+        {
+            clear();
+        }
+
+        inline xobserver_list::xobserver_list(xobserver_list&& rhs) noexcept
+            : xobserver_list()
+        {
+            steal(rhs);
+        }
+
+        inline xobserver_list& xobserver_list::operator=(xobserver_list&& rhs) noexcept
+        {
+            if (this != &rhs)
+            {
+                clear();
+                steal(rhs);
+            }
+            return *this;
+        }
+
+        inline bool xobserver_list::empty() const noexcept
+        {
+            return m_sentinel.p_next == &m_sentinel;
+        }
+
+        inline bool xobserver_list::requires_old_value() const noexcept
+        {
+            return m_old_value_count != 0;
+        }
+
+        inline void xobserver_list::push_back(xobserver_node& node) noexcept
+        {
+            node.p_prev = m_sentinel.p_prev;
+            node.p_next = &m_sentinel;
+            m_sentinel.p_prev->p_next = &node;
+            m_sentinel.p_prev = &node;
+            node.p_list = this;
+            if (node.m_needs_old)
+            {
+                ++m_old_value_count;
+            }
+        }
+
+        template <class C>
+        inline void xobserver_list::emplace_back(C&& cb, xobserver_pool& pool, bool needs_old)
+        {
+            push_back(*pool.create(std::forward<C>(cb), needs_old));
+        }
+
+        inline void xobserver_list::assign(const xobserver_list& rhs, xobserver_pool& pool)
+        {
+            if (this == &rhs)
+            {
+                return;
+            }
+            clear();
+            for (const xobserver_link* link = rhs.m_sentinel.p_next; link != &rhs.m_sentinel; link = link->p_next)
+            {
+                const xobserver_node* node = static_cast<const xobserver_node*>(link);
+                if (node->p_pool != nullptr)
+                {
+                    emplace_back(node->m_callback, pool, node->m_needs_old);
+                }
+            }
+        }
+
+        // Deletes the owned observers and detaches the connected ones. During an
+        // invocation, the owned observers are only deleted once it returns.
+        inline void xobserver_list::clear() noexcept
+        {
+            xobserver_link* link = m_sentinel.p_next;
+            while (link != &m_sentinel)
+            {
+                xobserver_node* node = static_cast<xobserver_node*>(link);
+                link = link->p_next;
+                node->p_prev = nullptr;
+                node->p_next = nullptr;
+                node->p_list = nullptr;
+                if (node->p_pool != nullptr)
+                {
+                    node->p_next = p_retired;
+                    p_retired = node;
+                }
+            }
+            m_sentinel.p_prev = &m_sentinel;
+            m_sentinel.p_next = &m_sentinel;
+            m_old_value_count = 0;
+            bool invoked = false;
+            for (iteration* it = iteration::innermost(); it != nullptr; it = it->p_outer)
+            {
+                if (&it->m_list == this)
+                {
+                    it->p_next = &m_sentinel;
+                    invoked = true;
+                }
+            }
+            if (!invoked)
+            {
+                destroy_retired();
+            }
+        }
+
+        // The tasks deferred by the observers run when the outermost invocation
+        // returns, even when an observer throws.
+
+        inline void xobserver_list::invoke(const void* owner, const void* change)
+        {
+            if (empty())
+            {
+                return;
+            }
+            try
+            {
+                iteration it(*this);
+                while (xobserver_node* node = it.next())
+                {
+                    node->m_callback(owner, change);
+                }
+            }
+            catch (...)
+            {
+                run_deferred();
+                throw;
+            }
+            run_deferred();
+        }
+
+        inline void xobserver_list::defer(xdeferred& task)
+        {
+            thread_state& state = local();
+            task.p_next = nullptr;
+            if (state.p_tail != nullptr)
+            {
+                state.p_tail->p_next = &task;
+            }
+            else
+            {
+                state.p_head = &task;
+            }
+            state.p_tail = &task;
+            run_deferred();
+        }
+
+        inline void xobserver_list::cancel(xdeferred& task) noexcept
+        {
+            thread_state& state = local();
+            xdeferred* prev = nullptr;
+            for (xdeferred* it = state.p_head; it != nullptr; prev = it, it = it->p_next)
+            {
+                if (it == &task)
+                {
+                    (prev != nullptr ? prev->p_next : state.p_head) = task.p_next;
+                    if (state.p_tail == &task)
+                    {
+                        state.p_tail = prev;
+                    }
+                    task.p_next = nullptr;
+                    return;
+                }
+            }
+        }
+
+        inline auto xobserver_list::local() noexcept -> thread_state&
+        {
+            static thread_local thread_state state;
+            return state;
+        }
+
+        // A task is dequeued before it runs, so that a throwing task leaves the
+        // next ones to the next invocation.
+
+        inline void xobserver_list::run_deferred()
+        {
+            thread_state& state = local();
+            while (state.p_head != nullptr && state.p_innermost == nullptr)
+            {
+                xdeferred* task = state.p_head;
+                state.p_head = task->p_next;
+                if (state.p_head == nullptr)
+                {
+                    state.p_tail = nullptr;
+                }
+                task->p_next = nullptr;
+                task->p_run(task->p_arg);
+            }
+        }
+
+        inline bool xobserver_list::invoking() const noexcept
+        {
+            for (const iteration* it = iteration::innermost(); it != nullptr; it = it->p_outer)
+            {
+                if (&it->m_list == this)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        inline void xobserver_list::steal(xobserver_list& rhs) noexcept
+        {
+            if (!rhs.empty())
+            {
+                m_sentinel.p_next = rhs.m_sentinel.p_next;
+                m_sentinel.p_prev = rhs.m_sentinel.p_prev;
+                m_sentinel.p_next->p_prev = &m_sentinel;
+                m_sentinel.p_prev->p_next = &m_sentinel;
+                rhs.m_sentinel.p_prev = &rhs.m_sentinel;
+                rhs.m_sentinel.p_next = &rhs.m_sentinel;
+                m_old_value_count = rhs.m_old_value_count;
+                rhs.m_old_value_count = 0;
+                for (xobserver_link* link = m_sentinel.p_next; link != &m_sentinel; link = link->p_next)
+                {
+                    static_cast<xobserver_node*>(link)->p_list = this;
+                }
+            }
+        }
+
+        // Moves the invocations in progress past a node being unlinked. When the node
+        // is the last one of an invocation, the previous node takes its place, unless
+        // the invocation would have invoked the node next.
+
+        inline void xobserver_list::skip(const xobserver_link* link) noexcept
+        {
+            for (iteration* it = iteration::innermost(); it != nullptr; it = it->p_outer)
+            {
+                if (&it->m_list != this)
+                {
+                    continue;
+                }
+                if (it->p_next == link)
+                {
+                    it->p_next = link == it->p_last ? &m_sentinel : link->p_next;
+                }
+                else if (it->p_last == link)
+                {
+                    it->p_last = link->p_prev;
+                }
+            }
+        }
+
+        inline void xobserver_list::substitute(const xobserver_link* link, xobserver_link* by) noexcept
+        {
+            for (iteration* it = iteration::innermost(); it != nullptr; it = it->p_outer)
+            {
+                if (&it->m_list != this)
+                {
+                    continue;
+                }
+                if (it->p_next == link)
+                {
+                    it->p_next = by;
+                }
+                if (it->p_last == link)
+                {
+                    it->p_last = by;
+                }
+            }
+        }
+
+        inline void xobserver_list::destroy_retired() noexcept
+        {
+            while (p_retired != nullptr)
+            {
+                xobserver_node* node = static_cast<xobserver_node*>(p_retired);
+                p_retired = node->p_next;
+                node->p_next = nullptr;
+                node->p_pool->destroy(node);
+            }
+        }
+    }
+
+    /*****************************
+     * connection implementation *
+     *****************************/
+
+    template <class C>
+    inline connection::connection(C&& cb, bool needs_old)
+        : m_node(std::forward<C>(cb), nullptr, needs_old)
+    {
+    }
+
+    inline connection::~connection()
+    {
+        m_node.unlink();
+    }
+
+    inline connection::connection(connection&& rhs) noexcept
+    {
+        m_node.replace(rhs.m_node);
+    }
+
+    inline connection& connection::operator=(connection&& rhs) noexcept
+    {
+        if (this != &rhs)
+        {
+            m_node.unlink();
+            m_node.replace(rhs.m_node);
+        }
+        return *this;
+    }
+
+    inline bool connection::connected() const noexcept
+    {
+        return m_node.linked();
+    }
+
+    inline void connection::disconnect() noexcept
+    {
+        m_node.unlink();
+    }
+}
+
+#endif
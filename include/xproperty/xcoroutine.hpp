@@ -0,0 +1,132 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XCOROUTINE_HPP
+#define XCOROUTINE_HPP
+
+#if defined(__has_include)
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#define XPROPERTY_HAS_COROUTINES 1
+#endif
+#endif
+
+#ifndef XPROPERTY_HAS_COROUTINES
+#define XPROPERTY_HAS_COROUTINES 0
+#endif
+
+#if XPROPERTY_HAS_COROUTINES
+
+#include <coroutine>
+#include <cstddef>
+
+#include "xconnection.hpp"
+#include "xobserved.hpp"
+#include "xproperty.hpp"
+
+namespace xp
+{
+
+    /********************************
+     * xchanged_awaiter declaration *
+     ********************************/
+
+    // Awaiter suspending a coroutine until the next change of a property. The
+    // observer node lives in the awaiter, hence in the coroutine frame: awaiting
+    // does not allocate once the owner has a callback table. The coroutine is
+    // resumed by the assignment, once the observers have been invoked, and the
+    // awaiter yields the new value.
+
+    template <class D, class P>
+    class xchanged_awaiter
+    {
+    public:
+
+        using value_type = typename P::value_type;
+
+        explicit xchanged_awaiter(xobserved<D>& owner) noexcept;
+        ~xchanged_awaiter();
+
+        xchanged_awaiter(const xchanged_awaiter&) = delete;
+        xchanged_awaiter& operator=(const xchanged_awaiter&) = delete;
+
+        bool await_ready() const noexcept;
+        void await_suspend(std::coroutine_handle<> handle);
+        value_type await_resume() const;
+
+    private:
+
+        static void resume(void* address);
+
+        xobserved<D>* p_owner;
+        detail::xdeferred m_resume;
+        connection m_connection;
+    };
+
+    // co_await xp::changed(owner, &Owner::attribute)
+
+    template <class D, class P>
+    xchanged_awaiter<D, P> changed(xobserved<D>& owner, P D::* attribute) noexcept;
+
+    /***********************************
+     * xchanged_awaiter implementation *
+     ***********************************/
+
+    template <class D, class P>
+    inline xchanged_awaiter<D, P>::xchanged_awaiter(xobserved<D>& owner) noexcept
+        : p_owner(&owner)
+    {
+    }
+
+    template <class D, class P>
+    inline xchanged_awaiter<D, P>::~xchanged_awaiter()
+    {
+        detail::xobserver_list::cancel(m_resume);
+    }
+
+    template <class D, class P>
+    inline bool xchanged_awaiter<D, P>::await_ready() const noexcept
+    {
+        return false;
+    }
+
+    template <class D, class P>
+    inline void xchanged_awaiter<D, P>::await_suspend(std::coroutine_handle<> handle)
+    {
+        m_resume.p_run = &xchanged_awaiter::resume;
+        m_resume.p_arg = handle.address();
+        m_connection = p_owner->template connect<P::offset()>([this](const D&) {
+            // Resuming may destroy the frame holding this observer, hence the
+            // resumption is deferred until the invocation of the observers returns.
+            xchanged_awaiter* self = this;
+            self->m_connection.disconnect();
+            detail::xobserver_list::defer(self->m_resume);
+        });
+    }
+
+    template <class D, class P>
+    inline void xchanged_awaiter<D, P>::resume(void* address)
+    {
+        std::coroutine_handle<>::from_address(address).resume();
+    }
+
+    template <class D, class P>
+    inline auto xchanged_awaiter<D, P>::await_resume() const -> value_type
+    {
+        return detail::get_property<P::offset()>(p_owner->derived_cast());
+    }
+
+    template <class D, class P>
+    inline xchanged_awaiter<D, P> changed(xobserved<D>& owner, P D::*) noexcept
+    {
+        return xchanged_awaiter<D, P>(owner);
+    }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,315 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XDELTA_HPP
+#define XDELTA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "xobserved.hpp"
+#include "xproperty.hpp"
+
+namespace xp
+{
+
+    /***********************
+     * xdelta_codec traits *
+     ***********************/
+
+    // xdelta_codec<T>
+    //
+    // Binary encoding of the values of type T in delta records. Specializations provide
+    //
+    //  - static std::size_t size(const T& value);
+    //  - static void write(const T& value, char* out);
+    //  - static T read(const char* in, std::size_t size);
+    //
+    // where `read` throws std::invalid_argument when the size does not match an encoded
+    // value. Trivially copyable types are copied bytewise, and std::string is supported.
+
+    template <class T, class = void>
+    struct xdelta_codec;
+
+    template <class T>
+    struct xdelta_codec<T, std::enable_if_t<std::is_trivially_copyable<T>::value>>
+    {
+        static std::size_t size(const T&) noexcept
+        {
+            return sizeof(T);
+        }
+
+        static void write(const T& value, char* out) noexcept
+        {
+            std::memcpy(out, &value, sizeof(T));
+        }
+
+        static T read(const char* in, std::size_t size)
+        {
+            if (size != sizeof(T))
+            {
+                throw std::invalid_argument("invalid size of a trivially copyable value in a delta record");
+            }
+            T value;
+            std::memcpy(&value, in, sizeof(T));
+            return value;
+        }
+    };
+
+    template <>
+    struct xdelta_codec<std::string>
+    {
+        static std::size_t size(const std::string& value) noexcept
+        {
+            return value.size();
+        }
+
+        static void write(const std::string& value, char* out) noexcept
+        {
+            std::memcpy(out, value.data(), value.size());
+        }
+
+        static std::string read(const char* in, std::size_t size)
+        {
+            return std::string(in, size);
+        }
+    };
+
+    // A delta record is the size of its payload, followed by one entry per property:
+    //
+    //   record := uint32 payload_size, entry...
+    //   entry  := uint16 index, uint32 value_size, value
+    //
+    // Integers are written in the byte order of the host, for exchanges between
+    // processes of the same machine.
+
+    // encode_properties(owner, buffer)
+    //
+    // Appends a record holding all the properties of the owner to the buffer. Throws
+    // std::length_error when a value or the record does not fit in 4 GiB, leaving the
+    // buffer unchanged.
+
+    template <class O>
+    void encode_properties(const O& owner, std::vector<char>& buffer);
+
+    // encode_delta(owner, buffer)
+    //
+    // Appends a record holding the dirty properties of the owner to the buffer, see
+    // xobserved::track_dirty. The dirty properties are not cleared. Throws like
+    // encode_properties.
+
+    template <class D>
+    void encode_delta(const xobserved<D>& owner, std::vector<char>& buffer);
+
+    // decode_delta(owner, data, size)
+    //
+    // Assigns the properties of the record starting at `data` to the owner, in the order
+    // of the record, through their validators and observers. Returns the size of the
+    // record, and throws std::invalid_argument when the record is malformed, before
+    // assigning any property. Values rejected by their codec or their validators are
+    // reported when they are reached, once the previous entries are assigned.
+
+    template <class O>
+    std::size_t decode_delta(O& owner, const char* data, std::size_t size);
+
+    /*************************
+     * xdelta implementation *
+     *************************/
+
+    namespace detail
+    {
+        using delta_size_type = std::uint32_t;
+        using delta_index_type = std::uint16_t;
+
+        constexpr std::size_t delta_header_size = sizeof(delta_size_type);
+        constexpr std::size_t delta_entry_header_size = sizeof(delta_index_type) + sizeof(delta_size_type);
+
+        static_assert(XPROPERTY_MAX_PROPERTIES <= 65536, "property indices of delta records are 16-bit");
+
+        template <class T>
+        inline void write_delta_integer(T value, char* out) noexcept
+        {
+            std::memcpy(out, &value, sizeof(T));
+        }
+
+        template <class T>
+        inline T read_delta_integer(const char* in) noexcept
+        {
+            T value;
+            std::memcpy(&value, in, sizeof(T));
+            return value;
+        }
+
+        class xdelta_writer
+        {
+        public:
+
+            explicit xdelta_writer(std::vector<char>& buffer);
+            ~xdelta_writer();
+
+            // Writes the size of the payload once all the entries are written.
+            void finish() noexcept;
+
+            xdelta_writer(const xdelta_writer&) = delete;
+            xdelta_writer& operator=(const xdelta_writer&) = delete;
+
+            template <class P>
+            void operator()(const P& property);
+
+        private:
+
+            std::vector<char>& m_buffer;
+            std::size_t m_start;
+            bool m_finished;
+        };
+
+        inline xdelta_writer::xdelta_writer(std::vector<char>& buffer)
+            : m_buffer(buffer), m_start(buffer.size()), m_finished(false)
+        {
+            m_buffer.resize(m_start + delta_header_size);
+        }
+
+        // A record which is not finished, because an entry failed, is removed.
+
+        inline xdelta_writer::~xdelta_writer()
+        {
+            if (!m_finished)
+            {
+                m_buffer.resize(m_start);
+            }
+        }
+
+        inline void xdelta_writer::finish() noexcept
+        {
+            write_delta_integer(static_cast<delta_size_type>(m_buffer.size() - m_start - delta_header_size), m_buffer.data() + m_start);
+            m_finished = true;
+        }
+
+        template <class P>
+        inline void xdelta_writer::operator()(const P& property)
+        {
+            using value_type = typename P::value_type;
+            using codec_type = xdelta_codec<value_type>;
+            typename P::const_reference value = static_cast<typename P::const_reference>(property);
+
+            // The sizes are checked before the buffer grows, the payload size is at
+            // least the size of each value.
+            constexpr std::size_t max_size = std::numeric_limits<delta_size_type>::max();
+            std::size_t value_size = codec_type::size(value);
+            std::size_t position = m_buffer.size();
+            std::size_t payload_size = position - m_start - delta_header_size;
+            if (value_size > max_size - delta_entry_header_size - payload_size)
+            {
+                throw std::length_error("delta record larger than 4 GiB");
+            }
+            m_buffer.resize(position + delta_entry_header_size + value_size);
+            char* out = m_buffer.data() + position;
+            write_delta_integer(static_cast<delta_index_type>(P::index()), out);
+            write_delta_integer(static_cast<delta_size_type>(value_size), out + sizeof(delta_index_type));
+            codec_type::write(value, out + delta_entry_header_size);
+        }
+
+        struct xdelta_reader
+        {
+            template <class P>
+            void operator()(P& property) const
+            {
+                using value_type = typename P::value_type;
+                property = xdelta_codec<value_type>::read(p_data, m_size);
+            }
+
+            const char* p_data;
+            std::size_t m_size;
+        };
+
+        // Calls `f(index, value, value_size)` with each entry of the record starting at
+        // `data`, for an owner with N properties, and returns the size of the record. The
+        // framing of the whole record is validated before the first call, so that a
+        // malformed record is not partially applied.
+
+        template <std::size_t N, class F>
+        inline std::size_t for_each_delta_entry(const char* data, std::size_t size, F&& f)
+        {
+            if (size < delta_header_size)
+            {
+                throw std::invalid_argument("truncated delta record");
+            }
+            std::size_t record_size = delta_header_size + read_delta_integer<delta_size_type>(data);
+            if (size < record_size)
+            {
+                throw std::invalid_argument("truncated delta record");
+            }
+
+            std::size_t position = delta_header_size;
+            while (position != record_size)
+            {
+                if (record_size - position < delta_entry_header_size)
+                {
+                    throw std::invalid_argument("truncated delta entry");
+                }
+                std::size_t index = read_delta_integer<delta_index_type>(data + position);
+                std::size_t value_size = read_delta_integer<delta_size_type>(data + position + sizeof(delta_index_type));
+                position += delta_entry_header_size;
+                if (index >= N)
+                {
+                    throw std::invalid_argument("invalid property index in delta record");
+                }
+                if (record_size - position < value_size)
+                {
+                    throw std::invalid_argument("truncated delta entry");
+                }
+                position += value_size;
+            }
+
+            position = delta_header_size;
+            while (position != record_size)
+            {
+                std::size_t index = read_delta_integer<delta_index_type>(data + position);
+                std::size_t value_size = read_delta_integer<delta_size_type>(data + position + sizeof(delta_index_type));
+                position += delta_entry_header_size;
+                f(index, data + position, value_size);
+                position += value_size;
+            }
+            return record_size;
+        }
+    }
+
+    template <class O>
+    inline void encode_properties(const O& owner, std::vector<char>& buffer)
+    {
+        detail::xdelta_writer writer(buffer);
+        for_each_property(owner, writer);
+        writer.finish();
+    }
+
+    template <class D>
+    inline void encode_delta(const xobserved<D>& owner, std::vector<char>& buffer)
+    {
+        detail::xdelta_writer writer(buffer);
+        owner.for_each_dirty(writer);
+        writer.finish();
+    }
+
+    template <class O>
+    inline std::size_t decode_delta(O& owner, const char* data, std::size_t size)
+    {
+        return detail::for_each_delta_entry<xproperty_count<O>::value>(data, size, [&owner](std::size_t index, const char* value, std::size_t value_size) {
+            detail::xdelta_reader reader = { value, value_size };
+            detail::visit_property(owner, index, reader, std::make_index_sequence<xproperty_count<O>::value>());
+        });
+    }
+}
+
+#endif
@@ -0,0 +1,329 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XEXECUTOR_HPP
+#define XEXECUTOR_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace xp
+{
+
+    /***************************
+     * xmpsc_queue declaration *
+     ***************************/
+
+    // Intrusive, unbounded, lock-free queue with multiple producers and a single
+    // consumer. Nodes derive from xmpsc_node and are not owned by the queue.
+
+    struct xmpsc_node
+    {
+        std::atomic<xmpsc_node*> p_next = { nullptr };
+    };
+
+    class xmpsc_queue
+    {
+    public:
+
+        xmpsc_queue() noexcept;
+
+        xmpsc_queue(const xmpsc_queue&) = delete;
+        xmpsc_queue& operator=(const xmpsc_queue&) = delete;
+
+        // Can be called concurrently.
+        void push(xmpsc_node* node) noexcept;
+
+        // Only called by the consumer. Returns nullptr when the queue is empty,
+        // or when the node following the last popped one is being pushed.
+        xmpsc_node* pop() noexcept;
+
+    private:
+
+        std::atomic<xmpsc_node*> p_head;
+        xmpsc_node* p_tail;
+        xmpsc_node m_stub;
+    };
+
+    /****************************
+     * xworker_pool declaration *
+     ****************************/
+
+    // Executor running the posted tasks on a fixed number of threads. Each thread
+    // consumes its own queue, and tasks posted with the same key go to the same
+    // thread, so that they run in the order in which they are posted.
+    //
+    // Any type providing `post(const void* key, F&& task)` can be used as an
+    // executor by `xobserved::observe_async`.
+    //
+    // A task which throws does not stop its worker: the first exception is kept,
+    // and rethrown by `drain`. Exceptions which are not rethrown when the pool is
+    // destroyed are discarded.
+
+    class xworker_pool
+    {
+    public:
+
+        explicit xworker_pool(std::size_t size = std::thread::hardware_concurrency());
+
+        // Runs the tasks already posted, then joins the threads.
+        ~xworker_pool();
+
+        xworker_pool(const xworker_pool&) = delete;
+        xworker_pool& operator=(const xworker_pool&) = delete;
+
+        std::size_t size() const noexcept;
+
+        template <class F>
+        void post(const void* key, F&& task);
+
+        // Waits until the tasks posted so far have run, then rethrows the first
+        // exception thrown by a task since the previous call, if any. Must not be
+        // called from a task.
+        void drain();
+
+    private:
+
+        struct task_base : xmpsc_node
+        {
+            virtual ~task_base() = default;
+            virtual void run() = 0;
+        };
+
+        template <class F>
+        struct task : task_base
+        {
+            explicit task(F&& f);
+            void run() override;
+
+            std::decay_t<F> m_function;
+        };
+
+        struct worker
+        {
+            xmpsc_queue m_queue;
+            std::atomic<bool> m_sleeping = { false };
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+            std::thread m_thread;
+        };
+
+        void run(worker& w);
+        void execute(xmpsc_node* node) noexcept;
+        void wake(worker& w);
+
+        std::vector<std::unique_ptr<worker>> m_workers;
+        std::atomic<bool> m_stopping = { false };
+
+        // Tasks posted and not run yet, and first exception thrown by a task.
+        std::atomic<std::size_t> m_pending = { 0 };
+        std::mutex m_mutex;
+        std::condition_variable m_drained;
+        std::exception_ptr m_exception;
+    };
+
+    /******************************
+     * xmpsc_queue implementation *
+     ******************************/
+
+    inline xmpsc_queue::xmpsc_queue() noexcept
+        : p_head(&m_stub), p_tail(&m_stub)
+    {
+    }
+
+    inline void xmpsc_queue::push(xmpsc_node* node) noexcept
+    {
+        node->p_next.store(nullptr, std::memory_order_relaxed);
+        xmpsc_node* prev = p_head.exchange(node);
+        prev->p_next.store(node);
+    }
+
+    inline xmpsc_node* xmpsc_queue::pop() noexcept
+    {
+        xmpsc_node* tail = p_tail;
+        xmpsc_node* next = tail->p_next.load();
+        if (tail == &m_stub)
+        {
+            if (next == nullptr)
+            {
+                return nullptr;
+            }
+            p_tail = next;
+            tail = next;
+            next = next->p_next.load();
+        }
+        if (next != nullptr)
+        {
+            p_tail = next;
+            return tail;
+        }
+        if (tail != p_head.load())
+        {
+            return nullptr;
+        }
+        push(&m_stub);
+        next = tail->p_next.load();
+        if (next != nullptr)
+        {
+            p_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    /*******************************
+     * xworker_pool implementation *
+     *******************************/
+
+    inline xworker_pool::xworker_pool(std::size_t size)
+    {
+        size = size == 0 ? 1 : size;
+        m_workers.reserve(size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            m_workers.push_back(std::make_unique<worker>());
+        }
+        for (auto& w : m_workers)
+        {
+            worker* p = w.get();
+            p->m_thread = std::thread([this, p]() { run(*p); });
+        }
+    }
+
+    inline xworker_pool::~xworker_pool()
+    {
+        m_stopping.store(true);
+        for (auto& w : m_workers)
+        {
+            wake(*w);
+        }
+        for (auto& w : m_workers)
+        {
+            w->m_thread.join();
+        }
+    }
+
+    inline std::size_t xworker_pool::size() const noexcept
+    {
+        return m_workers.size();
+    }
+
+    template <class F>
+    inline void xworker_pool::post(const void* key, F&& f)
+    {
+        worker& w = *m_workers[std::hash<const void*>()(key) % m_workers.size()];
+        task_base* t = new task<F>(std::forward<F>(f));
+        m_pending.fetch_add(1);
+        w.m_queue.push(t);
+        if (w.m_sleeping.load())
+        {
+            wake(w);
+        }
+    }
+
+    template <class F>
+    inline xworker_pool::task<F>::task(F&& f)
+        : m_function(std::forward<F>(f))
+    {
+    }
+
+    template <class F>
+    inline void xworker_pool::task<F>::run()
+    {
+        m_function();
+    }
+
+    // The worker announces that it goes to sleep before checking its queue a last
+    // time, and producers check the announcement after pushing, so that a task is
+    // never left behind a sleeping worker.
+
+    inline void xworker_pool::run(worker& w)
+    {
+        while (true)
+        {
+            if (xmpsc_node* node = w.m_queue.pop())
+            {
+                execute(node);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(w.m_mutex);
+            w.m_sleeping.store(true);
+            if (xmpsc_node* node = w.m_queue.pop())
+            {
+                w.m_sleeping.store(false);
+                lock.unlock();
+                execute(node);
+                continue;
+            }
+            if (m_stopping.load())
+            {
+                w.m_sleeping.store(false);
+                return;
+            }
+            w.m_condition.wait(lock, [&w]() { return !w.m_sleeping.load(); });
+        }
+    }
+
+    // The task is destroyed before it is accounted for, so that the state it
+    // captures is released when `drain` returns.
+
+    inline void xworker_pool::execute(xmpsc_node* node) noexcept
+    {
+        {
+            std::unique_ptr<task_base> t(static_cast<task_base*>(node));
+            try
+            {
+                t->run();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_exception)
+                {
+                    m_exception = std::current_exception();
+                }
+            }
+        }
+        if (m_pending.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_drained.notify_all();
+        }
+    }
+
+    inline void xworker_pool::drain()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_drained.wait(lock, [this]() { return m_pending.load() == 0; });
+        if (m_exception)
+        {
+            std::exception_ptr e = m_exception;
+            m_exception = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+    inline void xworker_pool::wake(worker& w)
+    {
+        std::lock_guard<std::mutex> lock(w.m_mutex);
+        w.m_sleeping.store(false);
+        w.m_condition.notify_one();
+    }
+}
+
+#endif
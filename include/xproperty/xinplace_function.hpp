@@ -0,0 +1,218 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XINPLACE_FUNCTION_HPP
+#define XINPLACE_FUNCTION_HPP
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "xproperty_config.hpp"
+
+namespace xp
+{
+
+    /*********************************
+     * xinplace_function declaration *
+     *********************************/
+
+    // Polymorphic function wrapper similar to std::function, storing the callable
+    // in an inline buffer of `Capacity` bytes. It never allocates: wrapping a
+    // callable that does not fit in the buffer is a compilation error.
+
+    template <class S, std::size_t Capacity = XPROPERTY_CALLBACK_CAPACITY, std::size_t Alignment = alignof(std::max_align_t)>
+    class xinplace_function;
+
+    template <class R, class... Args, std::size_t Capacity, std::size_t Alignment>
+    class xinplace_function<R(Args...), Capacity, Alignment>
+    {
+    public:
+
+        using result_type = R;
+
+        static constexpr std::size_t capacity = Capacity;
+        static constexpr std::size_t alignment = Alignment;
+
+        xinplace_function() noexcept;
+        xinplace_function(std::nullptr_t) noexcept;
+
+        template <class F, class = std::enable_if_t<!std::is_same<std::decay_t<F>, xinplace_function>::value>>
+        xinplace_function(F&& f);
+
+        ~xinplace_function();
+
+        xinplace_function(const xinplace_function& rhs);
+        xinplace_function& operator=(const xinplace_function& rhs);
+
+        xinplace_function(xinplace_function&& rhs) noexcept;
+        xinplace_function& operator=(xinplace_function&& rhs) noexcept;
+
+        explicit operator bool() const noexcept;
+
+        R operator()(Args... args) const;
+
+    private:
+
+        using storage_type = std::aligned_storage_t<Capacity, Alignment>;
+
+        struct vtable
+        {
+            R (*invoke)(void*, Args&&...);
+            void (*copy)(const void*, void*);
+            void (*move)(void*, void*);
+            void (*destroy)(void*);
+        };
+
+        template <class F>
+        static const vtable* vtable_for() noexcept;
+        static const vtable* empty_vtable() noexcept;
+
+        void reset() noexcept;
+
+        const vtable* p_vtable;
+        mutable storage_type m_storage;
+    };
+
+    /************************************
+     * xinplace_function implementation *
+     ************************************/
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline xinplace_function<R(Args...), C, A>::xinplace_function() noexcept
+        : p_vtable(empty_vtable())
+    {
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline xinplace_function<R(Args...), C, A>::xinplace_function(std::nullptr_t) noexcept
+        : p_vtable(empty_vtable())
+    {
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    template <class F, class>
+    inline xinplace_function<R(Args...), C, A>::xinplace_function(F&& f)
+        : p_vtable(vtable_for<std::decay_t<F>>())
+    {
+        using functor_type = std::decay_t<F>;
+        static_assert(sizeof(functor_type) <= C, "callable too large for xinplace_function, increase XPROPERTY_CALLBACK_CAPACITY");
+        static_assert(A % alignof(functor_type) == 0, "callable alignment not supported by xinplace_function");
+        static_assert(std::is_nothrow_move_constructible<functor_type>::value, "callable must be nothrow move constructible, xinplace_function moves are noexcept");
+        ::new (static_cast<void*>(&m_storage)) functor_type(std::forward<F>(f));
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline xinplace_function<R(Args...), C, A>::~xinplace_function()
+    {
+        p_vtable->destroy(&m_storage);
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline xinplace_function<R(Args...), C, A>::xinplace_function(const xinplace_function& rhs)
+        : p_vtable(rhs.p_vtable)
+    {
+        p_vtable->copy(&rhs.m_storage, &m_storage);
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline auto xinplace_function<R(Args...), C, A>::operator=(const xinplace_function& rhs) -> xinplace_function&
+    {
+        if (this != &rhs)
+        {
+            reset();
+            rhs.p_vtable->copy(&rhs.m_storage, &m_storage);
+            p_vtable = rhs.p_vtable;
+        }
+        return *this;
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline xinplace_function<R(Args...), C, A>::xinplace_function(xinplace_function&& rhs) noexcept
+        : p_vtable(rhs.p_vtable)
+    {
+        p_vtable->move(&rhs.m_storage, &m_storage);
+        rhs.reset();
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline auto xinplace_function<R(Args...), C, A>::operator=(xinplace_function&& rhs) noexcept -> xinplace_function&
+    {
+        if (this != &rhs)
+        {
+            reset();
+            rhs.p_vtable->move(&rhs.m_storage, &m_storage);
+            p_vtable = rhs.p_vtable;
+            rhs.reset();
+        }
+        return *this;
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline xinplace_function<R(Args...), C, A>::operator bool() const noexcept
+    {
+        return p_vtable != empty_vtable();
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline R xinplace_function<R(Args...), C, A>::operator()(Args... args) const
+    {
+        return p_vtable->invoke(&m_storage, std::forward<Args>(args)...);
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    template <class F>
+    inline auto xinplace_function<R(Args...), C, A>::vtable_for() noexcept -> const vtable*
+    {
+        static const vtable table = {
+            [](void* f, Args&&... args) -> R
+            {
+                return static_cast<R>((*static_cast<F*>(f))(std::forward<Args>(args)...));
+            },
+            [](const void* src, void* dst)
+            {
+                ::new (dst) F(*static_cast<const F*>(src));
+            },
+            [](void* src, void* dst)
+            {
+                ::new (dst) F(std::move(*static_cast<F*>(src)));
+            },
+            [](void* f)
+            {
+                static_cast<F*>(f)->~F();
+            }
+        };
+        return &table;
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline auto xinplace_function<R(Args...), C, A>::empty_vtable() noexcept -> const vtable*
+    {
+        static const vtable table = {
+            [](void*, Args&&...) -> R
+            {
+                throw std::bad_function_call();
+            },
+            [](const void*, void*) {},
+            [](void*, void*) {},
+            [](void*) {}
+        };
+        return &table;
+    }
+
+    template <class R, class... Args, std::size_t C, std::size_t A>
+    inline void xinplace_function<R(Args...), C, A>::reset() noexcept
+    {
+        p_vtable->destroy(&m_storage);
+        p_vtable = empty_vtable();
+    }
+}
+
+#endif
@@ -0,0 +1,219 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XJOURNAL_HPP
+#define XJOURNAL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#include "xproperty_config.hpp"
+
+namespace xp
+{
+
+    /******************
+     * xjournal_entry *
+     ******************/
+
+    // Record of a change of a property. The new value is only recorded for trivially
+    // copyable types of at most XPROPERTY_JOURNAL_VALUE_SIZE bytes, `value_size` is
+    // zero otherwise.
+
+    struct xjournal_entry
+    {
+        const void* object;
+        std::size_t offset;
+        // Ticks of std::chrono::steady_clock.
+        std::int64_t timestamp;
+        std::size_t value_size;
+        unsigned char value[XPROPERTY_JOURNAL_VALUE_SIZE];
+    };
+
+    /************************
+     * xjournal declaration *
+     ************************/
+
+    // Bounded lock-free ring buffer of changes, with multiple producers and a single
+    // consumer. Appending claims a slot with a compare-and-swap, then fills it: it never
+    // blocks nor allocates, and drops the change when the journal is full.
+    //
+    // An xobserved object appends each change of its properties to the journal set with
+    // `xobserved::set_journal`.
+
+    class xjournal
+    {
+    public:
+
+        // The capacity is rounded up to a power of two.
+        explicit xjournal(std::size_t capacity);
+
+        xjournal(const xjournal&) = delete;
+        xjournal& operator=(const xjournal&) = delete;
+
+        std::size_t capacity() const noexcept;
+
+        // Can be called concurrently. Returns false when the journal is full.
+        template <class T>
+        bool append(const void* object, std::size_t offset, const T& value) noexcept;
+
+        // Only called by the consumer. Returns false when the journal is empty, or when
+        // the oldest entry is being written.
+        bool pop(xjournal_entry& entry) noexcept;
+
+        // Only called by the consumer. Calls `f` with each available entry, in order,
+        // and returns the number of entries.
+        template <class F>
+        std::size_t drain(F&& f);
+
+        // Number of changes dropped because the journal was full.
+        std::size_t dropped() const noexcept;
+
+    private:
+
+        struct cell
+        {
+            std::atomic<std::size_t> m_sequence;
+            xjournal_entry m_entry;
+        };
+
+        template <class T>
+        static void record(xjournal_entry& entry, const T& value, std::true_type) noexcept;
+
+        template <class T>
+        static void record(xjournal_entry& entry, const T& value, std::false_type) noexcept;
+
+        // Producers and the consumer update different cache lines.
+        static constexpr std::size_t cache_line_size = 64;
+
+        std::unique_ptr<cell[]> p_cells;
+        std::size_t m_mask;
+        char m_pad0[cache_line_size];
+        std::atomic<std::size_t> m_append_position;
+        std::atomic<std::size_t> m_dropped;
+        char m_pad1[cache_line_size];
+        std::atomic<std::size_t> m_pop_position;
+    };
+
+    /***************************
+     * xjournal implementation *
+     ***************************/
+
+    inline xjournal::xjournal(std::size_t capacity)
+        : m_append_position(0), m_dropped(0), m_pop_position(0)
+    {
+        std::size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        p_cells.reset(new cell[size]);
+        m_mask = size - 1;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            p_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    inline std::size_t xjournal::capacity() const noexcept
+    {
+        return m_mask + 1;
+    }
+
+    // A cell is free for the append at position p when its sequence is p, and holds the
+    // entry appended at position p when its sequence is p + 1.
+
+    template <class T>
+    inline bool xjournal::append(const void* object, std::size_t offset, const T& value) noexcept
+    {
+        std::size_t position = m_append_position.load(std::memory_order_relaxed);
+        cell* c;
+        while (true)
+        {
+            c = &p_cells[position & m_mask];
+            std::size_t sequence = c->m_sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence - position);
+            if (diff == 0)
+            {
+                if (m_append_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                position = m_append_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        xjournal_entry& entry = c->m_entry;
+        entry.object = object;
+        entry.offset = offset;
+        entry.timestamp = std::chrono::steady_clock::now().time_since_epoch().count();
+        record(entry, value, std::integral_constant<bool, std::is_trivially_copyable<T>::value && sizeof(T) <= XPROPERTY_JOURNAL_VALUE_SIZE>());
+        c->m_sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    inline bool xjournal::pop(xjournal_entry& entry) noexcept
+    {
+        std::size_t position = m_pop_position.load(std::memory_order_relaxed);
+        cell& c = p_cells[position & m_mask];
+        if (c.m_sequence.load(std::memory_order_acquire) != position + 1)
+        {
+            return false;
+        }
+        entry = c.m_entry;
+        m_pop_position.store(position + 1, std::memory_order_relaxed);
+        c.m_sequence.store(position + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <class F>
+    inline std::size_t xjournal::drain(F&& f)
+    {
+        std::size_t count = 0;
+        xjournal_entry entry;
+        while (pop(entry))
+        {
+            f(static_cast<const xjournal_entry&>(entry));
+            ++count;
+        }
+        return count;
+    }
+
+    inline std::size_t xjournal::dropped() const noexcept
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    template <class T>
+    inline void xjournal::record(xjournal_entry& entry, const T& value, std::true_type) noexcept
+    {
+        std::memcpy(entry.value, &value, sizeof(T));
+        entry.value_size = sizeof(T);
+    }
+
+    template <class T>
+    inline void xjournal::record(xjournal_entry& entry, const T&, std::false_type) noexcept
+    {
+        entry.value_size = 0;
+    }
+}
+
+#endif
@@ -10,25 +10,51 @@
 #define XOBSERVED_HPP
 
 #include <type_traits>
+#include <array>
+#include <atomic>
+#include <bitset>
 #include <cstddef>
-#include <unordered_map>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <utility>
 #include <vector>
-#include <functional>
 
+#include "xconnection.hpp"
+#include "xinplace_function.hpp"
+#include "xjournal.hpp"
 #include "xproperty.hpp"
-#include "any.hpp"
 
 namespace xp
 {
 
     // XOBSERVE(owner, Attribute, Callback)
     // Register a callback reacting to changes of the specified attribute of the owner.
+    // Callbacks taking an xp::change are passed the current value as both the old and
+    // the new value when the previous value was not kept, which happens when they are
+    // registered while the notifications are held, after the first assignment.
 
     #define XOBSERVE(O, A, C) \
     O.observe<xoffsetof(decltype(O), A)>(C);
 
+    // XCONNECT(owner, Attribute, Callback)
+    // Register a callback reacting to changes of the specified attribute of the owner,
+    // and returns the xp::connection which unregisters it when destroyed.
+
+    #define XCONNECT(O, A, C) \
+    O.connect<xoffsetof(decltype(O), A)>(C)
+
+    // XOBSERVE_ASYNC(owner, Attribute, Executor, Callback)
+    // Register a callback taking the owner and the new value of the specified attribute,
+    // which is posted to the executor upon each change instead of being invoked inline.
+
+    #define XOBSERVE_ASYNC(O, A, E, C) \
+    O.observe_async<xoffsetof(decltype(O), A)>(E, C);
+
     // XUNOBSERVE(owner, Attribute)
-    // Removes all callbacks reacting to changes of the specified attribute of the owner.
+    // Removes all callbacks, including connected ones, reacting to changes of the specified attribute of the owner.
 
     #define XUNOBSERVE(O, A) \
     O.unobserve<xoffsetof(decltype(O), A)>();
@@ -37,7 +63,7 @@ namespace xp
     // Register a validator for proposed values of the specified attribute.
 
     #define XVALIDATE(O, A, C) \
-    O.validate<xoffsetof(decltype(O), A)>(std::function<typename decltype(O.A)::value_type(const decltype(O)&, typename decltype(O.A)::value_type)>(C));
+    O.validate<xoffsetof(decltype(O), A)>(C);
 
     // XUNVALIDATE(owner, Attribute)
     // Removes all validators for proposed values of the specified attribute.
@@ -45,20 +71,538 @@ namespace xp
     #define XUNVALIDATE(O, A) \
     O.unvalidate<xoffsetof(decltype(O), A)>();
 
+    // XOBSERVE_ALL(Type, Attribute, Callback)
+    // Register a callback reacting to changes of the specified attribute of any instance of the type.
+
+    #define XOBSERVE_ALL(T, A, C) \
+    T::observe_all<xoffsetof(T, A)>(C);
+
+    // XUNOBSERVE_ALL(Type, Attribute)
+    // Removes all the type-level callbacks reacting to changes of the specified attribute.
+
+    #define XUNOBSERVE_ALL(T, A) \
+    T::unobserve_all<xoffsetof(T, A)>();
+
+    // XVALIDATE_ALL(Type, Attribute, Validator)
+    // Register a validator for proposed values of the specified attribute of any instance of the type.
+
+    #define XVALIDATE_ALL(T, A, C) \
+    T::validate_all<xoffsetof(T, A)>(C);
+
+    // XUNVALIDATE_ALL(Type, Attribute)
+    // Removes all the type-level validators for proposed values of the specified attribute.
+
+    #define XUNVALIDATE_ALL(T, A) \
+    T::unvalidate_all<xoffsetof(T, A)>();
+
     // XDLINK(Source, AttributeName, Target, AttributeName)
     // Link the value of an attribute of a source xobserved object with the value of a target object.
 
     #define XDLINK(S, SA, T, TA) \
     T.TA = S.SA;\
-    S.observe<xoffsetof(decltype(S), SA)>([&S, &T] (const auto&) { T.TA = S.SA; });
+    S.observe<xoffsetof(decltype(S), SA)>([&S, &T] (const auto&) { ::xp::detail::propagate(&S.SA, &T.TA, [&S, &T] () { T.TA = S.SA; }); });
 
     // XLINK(Source, AttributeName, Target, AttributeName)
     // Bidirectional link between attributes of two xobserved objects.
+    //
+    // A change crosses each link at most once per originating assignment: a link does
+    // not assign a property whose change is being propagated on the current thread.
 
     #define XLINK(S, SA, T, TA) \
     T.TA = S.SA;\
-    S.observe<xoffsetof(decltype(S), SA)>([&S, &T] (const auto&) { T.TA = S.SA; });\
-    T.observe<xoffsetof(decltype(T), TA)>([&S, &T] (const auto&) { S.SA = T.TA; });
+    S.observe<xoffsetof(decltype(S), SA)>([&S, &T] (const auto&) { ::xp::detail::propagate(&S.SA, &T.TA, [&S, &T] () { T.TA = S.SA; }); });\
+    T.observe<xoffsetof(decltype(T), TA)>([&S, &T] (const auto&) { ::xp::detail::propagate(&T.TA, &S.SA, [&S, &T] () { S.SA = T.TA; }); });
+
+    /**********
+     * change *
+     **********/
+
+    // Previous and new value of a property, passed to the observers taking
+    // a second argument. The references are only valid during the call.
+
+    template <class T>
+    struct change
+    {
+        const T& old_value;
+        const T& new_value;
+    };
+
+    namespace detail
+    {
+        /********************
+         * link propagation *
+         ********************/
+
+        // Stack of the properties whose change is being propagated through links on
+        // the current thread. Frames live on the call stack of `propagate`.
+
+        struct xlink_frame
+        {
+            const void* p_source;
+            const xlink_frame* p_parent;
+        };
+
+        inline const xlink_frame*& link_stack_top() noexcept
+        {
+            static thread_local const xlink_frame* top = nullptr;
+            return top;
+        }
+
+        // Assigns the target of a link with the value of the source, unless the
+        // change of the target is already being propagated.
+
+        template <class F>
+        inline void propagate(const void* source, const void* target, F&& assign)
+        {
+            const xlink_frame*& top = link_stack_top();
+            for (const xlink_frame* frame = top; frame != nullptr; frame = frame->p_parent)
+            {
+                if (frame->p_source == target)
+                {
+                    return;
+                }
+            }
+
+            struct frame_guard
+            {
+                const xlink_frame*& m_top;
+                xlink_frame m_frame;
+
+                ~frame_guard()
+                {
+                    m_top = m_frame.p_parent;
+                }
+            };
+
+            frame_guard guard = { top, { source, top } };
+            top = &guard.m_frame;
+            assign();
+        }
+
+        template <class D, std::size_t Offset>
+        using xproperty_value_type = typename xproperty_type<D, xproperty_index_of<D, Offset>::value>::value_type;
+
+        // Observers taking the owner and an `xp::change` are invoked with the previous
+        // and the new value of the property, other observers only take the owner.
+
+        template <class C, class D, class T, class = void>
+        struct is_change_observer : std::false_type
+        {
+        };
+
+        template <class C, class D, class T>
+        struct is_change_observer<C, D, T, void_t<decltype(std::declval<C&>()(std::declval<const D&>(), std::declval<const change<T>&>()))>>
+            : std::true_type
+        {
+        };
+
+        template <class D, std::size_t Offset, class C>
+        inline auto make_observer_callback(C&& cb, std::false_type)
+        {
+            return [cb = std::forward<C>(cb)](const void* owner, const void*) mutable { cb(*static_cast<const D*>(owner)); };
+        }
+
+        // The change is not available to observers registered while the notifications
+        // are held, after the first assignment of the property: they are passed the
+        // current value as both the old and the new value.
+
+        template <class D, std::size_t Offset, class C>
+        inline auto make_observer_callback(C&& cb, std::true_type)
+        {
+            using value_type = xproperty_value_type<D, Offset>;
+            return [cb = std::forward<C>(cb)](const void* owner, const void* c) mutable {
+                const D& d = *static_cast<const D*>(owner);
+                if (c != nullptr)
+                {
+                    cb(d, *static_cast<const change<value_type>*>(c));
+                }
+                else
+                {
+                    const auto& value = get_property<Offset>(d);
+                    const change<value_type> current = { value, value };
+                    cb(d, current);
+                }
+            };
+        }
+
+        template <class D, std::size_t Offset, class C>
+        inline auto make_observer_callback(C&& cb)
+        {
+            using value_type = xproperty_value_type<D, Offset>;
+            return make_observer_callback<D, Offset>(std::forward<C>(cb), is_change_observer<std::decay_t<C>, D, value_type>());
+        }
+
+        template <class D, std::size_t Offset, class E, class C>
+        inline auto make_async_observer_callback(E& executor, C&& cb)
+        {
+            using value_type = xproperty_value_type<D, Offset>;
+            return [p_executor = &executor, cb = std::forward<C>(cb)](const void* owner, const void* c) {
+                const D* d = static_cast<const D*>(owner);
+                value_type value = c != nullptr ? static_cast<const change<value_type>*>(c)->new_value : get_property<Offset>(*d);
+                p_executor->post(static_cast<const char*>(owner) + Offset, [d, cb, value = std::move(value)]() mutable { cb(*d, value); });
+            };
+        }
+
+        // Static callbacks of owners using MAKE_HYBRID_OBSERVED.
+
+        template <std::size_t I, class D>
+        inline void invoke_static_observers(const D& owner, std::true_type)
+        {
+            owner.template invoke_static_observers<I>(std::make_index_sequence<XPROPERTY_STATIC_COUNT(xstatic_observer_slots, D, I)>());
+        }
+
+        template <std::size_t I, class D>
+        inline void invoke_static_observers(const D&, std::false_type) noexcept
+        {
+        }
+
+        template <std::size_t I, class D, class T>
+        inline void invoke_static_validators(const D& owner, T& proposal, std::true_type)
+        {
+            proposal = owner.template invoke_static_validators<I>(std::move(proposal), std::make_index_sequence<XPROPERTY_STATIC_COUNT(xstatic_validator_slots, D, I)>());
+        }
+
+        template <std::size_t I, class D, class T>
+        inline void invoke_static_validators(const D&, T&, std::false_type) noexcept
+        {
+        }
+
+        // Optional value, storing the previous value of a property whose notification
+        // is held, or a proposal of an xpatch.
+
+        template <class T>
+        class xoptional
+        {
+        public:
+
+            xoptional() noexcept = default;
+            ~xoptional();
+
+            xoptional(const xoptional&) = delete;
+            xoptional& operator=(const xoptional&) = delete;
+
+            bool has_value() const noexcept;
+            T& value() noexcept;
+            const T& value() const noexcept;
+
+            void emplace(T&& value);
+            void reset() noexcept;
+
+        private:
+
+            std::aligned_storage_t<sizeof(T), alignof(T)> m_storage;
+            bool m_engaged = false;
+        };
+
+        template <class T>
+        inline xoptional<T>::~xoptional()
+        {
+            reset();
+        }
+
+        template <class T>
+        inline bool xoptional<T>::has_value() const noexcept
+        {
+            return m_engaged;
+        }
+
+        template <class T>
+        inline T& xoptional<T>::value() noexcept
+        {
+            return *reinterpret_cast<T*>(&m_storage);
+        }
+
+        template <class T>
+        inline const T& xoptional<T>::value() const noexcept
+        {
+            return *reinterpret_cast<const T*>(&m_storage);
+        }
+
+        template <class T>
+        inline void xoptional<T>::emplace(T&& value)
+        {
+            reset();
+            ::new (static_cast<void*>(&m_storage)) T(std::move(value));
+            m_engaged = true;
+        }
+
+        template <class T>
+        inline void xoptional<T>::reset() noexcept
+        {
+            if (m_engaged)
+            {
+                reinterpret_cast<T*>(&m_storage)->~T();
+                m_engaged = false;
+            }
+        }
+
+        // Fixed-size set of property indices, scanned a 64-bit word at a time.
+
+        template <std::size_t N>
+        class xbitmask
+        {
+        public:
+
+            void set(std::size_t i) noexcept;
+            void reset(std::size_t i) noexcept;
+            bool test(std::size_t i) const noexcept;
+            bool any() const noexcept;
+            void clear() noexcept;
+
+            // Calls f with each index of the set, in increasing order.
+            template <class F>
+            void for_each(F&& f) const;
+
+        private:
+
+            static constexpr std::size_t word_count = (N + 63) / 64;
+
+            std::array<std::uint64_t, word_count> m_words = {};
+        };
+
+        inline std::size_t count_trailing_zeros(std::uint64_t word) noexcept
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<std::size_t>(__builtin_ctzll(word));
+#else
+            std::size_t res = 0;
+            while ((word & 1u) == 0)
+            {
+                word >>= 1;
+                ++res;
+            }
+            return res;
+#endif
+        }
+
+        template <std::size_t N>
+        inline void xbitmask<N>::set(std::size_t i) noexcept
+        {
+            m_words[i / 64] |= std::uint64_t(1) << (i % 64);
+        }
+
+        template <std::size_t N>
+        inline void xbitmask<N>::reset(std::size_t i) noexcept
+        {
+            m_words[i / 64] &= ~(std::uint64_t(1) << (i % 64));
+        }
+
+        template <std::size_t N>
+        inline bool xbitmask<N>::test(std::size_t i) const noexcept
+        {
+            return (m_words[i / 64] & (std::uint64_t(1) << (i % 64))) != 0;
+        }
+
+        template <std::size_t N>
+        inline bool xbitmask<N>::any() const noexcept
+        {
+            for (std::uint64_t word : m_words)
+            {
+                if (word != 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        template <std::size_t N>
+        inline void xbitmask<N>::clear() noexcept
+        {
+            m_words.fill(0);
+        }
+
+        template <std::size_t N>
+        template <class F>
+        inline void xbitmask<N>::for_each(F&& f) const
+        {
+            for (std::size_t w = 0; w < word_count; ++w)
+            {
+                for (std::uint64_t word = m_words[w]; word != 0; word &= word - 1)
+                {
+                    f(w * 64 + count_trailing_zeros(word));
+                }
+            }
+        }
+
+        // xbitmask whose words are atomic, so that indices can be set concurrently.
+        // Setting an index only writes its word when the index is not set yet.
+
+        template <std::size_t N>
+        class xatomic_bitmask
+        {
+        public:
+
+            xatomic_bitmask() noexcept;
+
+            xatomic_bitmask(const xatomic_bitmask&) = delete;
+            xatomic_bitmask& operator=(const xatomic_bitmask&) = delete;
+
+            void set(std::size_t i) noexcept;
+            bool test(std::size_t i) const noexcept;
+            bool any() const noexcept;
+            void clear() noexcept;
+
+            template <class F>
+            void for_each(F&& f) const;
+
+        private:
+
+            static constexpr std::size_t word_count = (N + 63) / 64;
+
+            std::array<std::atomic<std::uint64_t>, word_count> m_words;
+        };
+
+        template <std::size_t N>
+        inline xatomic_bitmask<N>::xatomic_bitmask() noexcept
+        {
+            clear();
+        }
+
+        template <std::size_t N>
+        inline void xatomic_bitmask<N>::set(std::size_t i) noexcept
+        {
+            std::uint64_t bit = std::uint64_t(1) << (i % 64);
+            std::atomic<std::uint64_t>& word = m_words[i / 64];
+            if ((word.load(std::memory_order_relaxed) & bit) == 0)
+            {
+                word.fetch_or(bit, std::memory_order_relaxed);
+            }
+        }
+
+        template <std::size_t N>
+        inline bool xatomic_bitmask<N>::test(std::size_t i) const noexcept
+        {
+            return (m_words[i / 64].load(std::memory_order_relaxed) & (std::uint64_t(1) << (i % 64))) != 0;
+        }
+
+        template <std::size_t N>
+        inline bool xatomic_bitmask<N>::any() const noexcept
+        {
+            for (const auto& word : m_words)
+            {
+                if (word.load(std::memory_order_relaxed) != 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        template <std::size_t N>
+        inline void xatomic_bitmask<N>::clear() noexcept
+        {
+            for (auto& word : m_words)
+            {
+                word.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        template <std::size_t N>
+        template <class F>
+        inline void xatomic_bitmask<N>::for_each(F&& f) const
+        {
+            for (std::size_t w = 0; w < word_count; ++w)
+            {
+                for (std::uint64_t word = m_words[w].load(std::memory_order_relaxed); word != 0; word &= word - 1)
+                {
+                    f(w * 64 + count_trailing_zeros(word));
+                }
+            }
+        }
+
+        template <class D, class S>
+        struct xvalidator_chains;
+
+        template <class D, std::size_t... I>
+        struct xvalidator_chains<D, std::index_sequence<I...>>
+        {
+            template <std::size_t J>
+            using value_type = typename xproperty_type<D, J>::value_type;
+
+            using type = std::tuple<std::vector<xinplace_function<value_type<I>(const D&, value_type<I>)>>...>;
+            using old_values_type = std::tuple<xoptional<value_type<I>>...>;
+        };
+
+        // Observers and validators of an owner, with one observer list and one validator
+        // chain per property, typed after the value type of the property. Only
+        // instantiated once the owner type is complete.
+
+        template <class D>
+        struct xobserved_table
+        {
+            using chains_type = typename xvalidator_chains<D, std::make_index_sequence<xproperty_count<D>::value>>::type;
+            using old_values_type = typename xvalidator_chains<D, std::make_index_sequence<xproperty_count<D>::value>>::old_values_type;
+
+            xobserved_table() = default;
+
+            // Copying a table copies the callbacks, not the held notifications,
+            // the dirty properties and the journal.
+            xobserved_table(const xobserved_table& rhs);
+            xobserved_table& operator=(const xobserved_table& rhs);
+
+            template <std::size_t I, class C>
+            void observe(C&& cb, bool needs_old = false);
+
+            template <std::size_t I, class T>
+            void validate(const D& owner, T& proposal) const;
+
+            // Declared first, so that it outlives the nodes of the observer lists.
+            xobserver_pool m_pool;
+            std::array<xobserver_list, xproperty_count<D>::value> m_observers;
+            chains_type m_validators;
+
+            // Depth of the nested notification holds, and properties changed meanwhile.
+            std::size_t m_hold_depth = 0;
+            std::bitset<xproperty_count<D>::value> m_pending;
+            old_values_type m_old_values;
+
+            // Properties assigned since the last call to clear_dirty. The words are atomic
+            // since atomic properties can be assigned concurrently.
+            xatomic_bitmask<xproperty_count<D>::value> m_dirty;
+
+            xjournal* p_journal = nullptr;
+        };
+
+        template <class D>
+        inline xobserved_table<D>::xobserved_table(const xobserved_table& rhs)
+            : m_validators(rhs.m_validators)
+        {
+            for (std::size_t i = 0; i < m_observers.size(); ++i)
+            {
+                m_observers[i].assign(rhs.m_observers[i], m_pool);
+            }
+        }
+
+        template <class D>
+        inline auto xobserved_table<D>::operator=(const xobserved_table& rhs) -> xobserved_table&
+        {
+            for (std::size_t i = 0; i < m_observers.size(); ++i)
+            {
+                m_observers[i].assign(rhs.m_observers[i], m_pool);
+            }
+            m_validators = rhs.m_validators;
+            return *this;
+        }
+
+        template <class D>
+        template <std::size_t I, class C>
+        inline void xobserved_table<D>::observe(C&& cb, bool needs_old)
+        {
+            std::get<I>(m_observers).emplace_back(std::forward<C>(cb), m_pool, needs_old);
+        }
+
+        template <class D>
+        template <std::size_t I, class T>
+        inline void xobserved_table<D>::validate(const D& owner, T& proposal) const
+        {
+            const auto& callbacks = std::get<I>(m_validators);
+            for (auto it = callbacks.cbegin(); it != callbacks.cend(); ++it) 
+            {
+                proposal = it->operator()(owner, std::move(proposal));
+            }
+        }
+    }
 
     /*************************
      * xobserved declaration *
@@ -74,39 +618,150 @@ namespace xp
         derived_type& derived_cast() noexcept;
         const derived_type& derived_cast() const noexcept;
 
-        template <std::size_t I>
-        void observe(std::function<void(const derived_type&)> cb);
+        template <std::size_t I, class C>
+        void observe(C&& cb);
+
+        template <std::size_t I, class C>
+        connection connect(C&& cb);
+
+        // Posts the callback, with a copy of the new value, to the executor upon each
+        // change of the property. The executor is given the address of the property as
+        // ordering key. The owner and the executor must outlive the posted tasks.
+
+        template <std::size_t I, class E, class C>
+        void observe_async(E& executor, C&& cb);
 
         template <std::size_t I>
         void unobserve();
 
-        template <std::size_t I, class V>
-        void validate(std::function<V(const derived_type&, V)> cb);
+        template <std::size_t I, class C>
+        void validate(C&& cb);
 
         template <std::size_t I>
         void unvalidate();
 
+        // Type-level callbacks, invoked for every instance before the callbacks
+        // registered on the instance.
+
+        template <std::size_t I, class C>
+        static void observe_all(C&& cb);
+
+        template <std::size_t I, class C>
+        static connection connect_all(C&& cb);
+
+        template <std::size_t I>
+        static void unobserve_all();
+
+        template <std::size_t I, class C>
+        static void validate_all(C&& cb);
+
+        template <std::size_t I>
+        static void unvalidate_all();
+
+        // Whether an observer of the property takes an `xp::change`, in which case
+        // the previous value of the property is kept upon assignment.
+
+        template <std::size_t I>
+        bool requires_old_value() const noexcept;
+
+        // While notifications are held, dynamic observers are not invoked upon assignment.
+        // The observers of each property changed meanwhile are invoked once, when
+        // the outermost hold is released. Validators, and the static observers of
+        // owners using MAKE_HYBRID_OBSERVED, still run upon assignment.
+
+        void hold_notifications();
+        void release_notifications();
+
+        // Once dirty tracking is enabled, each assignment marks its property as dirty,
+        // until `clear_dirty` is called. Tracking allocates the side table, and costs
+        // a test of an atomic word per assignment, and an atomic bit set when the
+        // property is not dirty yet. Atomic properties can be marked concurrently; a
+        // property marked while `for_each_dirty` and `clear_dirty` run may be lost.
+
+        void track_dirty();
+
+        bool dirty() const noexcept;
+
+        template <std::size_t I>
+        bool dirty() const noexcept;
+
+        void clear_dirty() noexcept;
+
+        // Calls `f` with each dirty property, in declaration order, see `for_each_property`.
+        template <class F>
+        void for_each_dirty(F&& f) const;
+
+        // Appends each assignment of a property to the journal, which must outlive the
+        // object or be unset. A null pointer stops the journaling.
+
+        void set_journal(xjournal* journal);
+
     protected:
 
         xobserved() = default;
         ~xobserved() = default;
 
-        xobserved(const xobserved&) = default;
-        xobserved& operator=(const xobserved&) = default;
+        xobserved(const xobserved&);
+        xobserved& operator=(const xobserved&);
 
         xobserved(xobserved&&) = default;
         xobserved& operator=(xobserved&&) = default;
 
     private:
 
-        std::unordered_map<std::size_t, std::vector<std::function<void(const derived_type&)>>> m_observers;
-        std::unordered_map<std::size_t, std::vector<linb::any>> m_validators;
+        using observer_list = detail::xobserver_list;
+        using table_type = detail::xobserved_table<derived_type>;
+
+        // Null until the first observer or validator is registered, so that objects
+        // which are never observed only pay for a pointer.
+        std::unique_ptr<table_type> p_table;
+
+        // Type-level table, null until the first type-level callback is registered.
+        static std::unique_ptr<table_type> p_class_table;
     
         template <class X, class Y, class Z>
         friend class xproperty;
 
+        template <class X, class Y, class Z>
+        friend class xatomic_property;
+
+        friend struct detail::xproperty_access;
+
+        static table_type& table(std::unique_ptr<table_type>& ptr);
+
+        template <std::size_t I>
+        static observer_list& observers(std::unique_ptr<table_type>& ptr);
+
         template <std::size_t I>
         void invoke_observers() const;
+
+        template <std::size_t I, class T>
+        void invoke_observers(T&& old_value) const;
+
+        // Marks the property as dirty and appends its value to the journal, see
+        // detail::xproperty_access::record.
+        bool records_changes() const noexcept;
+
+        template <std::size_t I>
+        void record_change() const;
+
+        template <std::size_t I, class V>
+        void record_change(const V& value) const;
+
+        // Atomic properties pass the value they stored, since another thread may have
+        // modified the property since then, and do not coalesce their notifications,
+        // since holds are not synchronized with concurrent assignments.
+        template <std::size_t I, class T>
+        void invoke_atomic_observers(const T& new_value) const;
+
+        template <std::size_t I, class T>
+        void invoke_atomic_observers(const T& old_value, const T& new_value) const;
+
+        template <std::size_t N>
+        void notify(const void* change = nullptr) const;
+
+        template <std::size_t... N>
+        void notify_pending(std::index_sequence<N...>);
         
         template <std::size_t I, class V>
         auto invoke_validators(V&& r) const;
@@ -115,10 +770,59 @@ namespace xp
     template <class E>
     using is_xobserved = std::is_base_of<xobserved<E>, E>;
 
+    /**********************************
+     * xnotification_hold declaration *
+     **********************************/
+
+    // Scope holding the notifications of an xobserved object, see
+    // xobserved::hold_notifications. Holds can be nested.
+
+    template <class D>
+    class xnotification_hold
+    {
+    public:
+
+        explicit xnotification_hold(xobserved<D>& owner);
+        ~xnotification_hold();
+
+        xnotification_hold(const xnotification_hold&) = delete;
+        xnotification_hold& operator=(const xnotification_hold&) = delete;
+
+        xnotification_hold(xnotification_hold&& rhs) noexcept;
+        xnotification_hold& operator=(xnotification_hold&&) = delete;
+
+        // Releases the hold before the end of the scope, and propagates the first
+        // exception thrown by the observers. The destructor swallows them instead.
+        void release();
+
+    private:
+
+        xobserved<D>* p_owner;
+    };
+
+    template <class D>
+    xnotification_hold<D> hold_notifications(xobserved<D>& owner);
+
     /****************************
      * xobserved implementation *
      ****************************/
 
+    template <class D>
+    std::unique_ptr<typename xobserved<D>::table_type> xobserved<D>::p_class_table;
+
+    template <class D>
+    inline xobserved<D>::xobserved(const xobserved& rhs)
+        : p_table(rhs.p_table ? std::make_unique<table_type>(*rhs.p_table) : nullptr)
+    {
+    }
+
+    template <class D>
+    inline auto xobserved<D>::operator=(const xobserved& rhs) -> xobserved&
+    {
+        p_table = rhs.p_table ? std::make_unique<table_type>(*rhs.p_table) : nullptr;
+        return *this;
+    }
+
     template <class D>
     inline auto xobserved<D>::derived_cast() noexcept -> derived_type&
     {
@@ -131,82 +835,408 @@ namespace xp
         return *static_cast<const derived_type*>(this);
     }
 
+    template <class D>
+    template <std::size_t I, class C>
+    inline void xobserved<D>::observe(C&& cb)
+    {
+        using value_type = detail::xproperty_value_type<derived_type, I>;
+        table(p_table).template observe<xproperty_index_of<derived_type, I>::value>(detail::make_observer_callback<derived_type, I>(std::forward<C>(cb)),
+                                                                                   detail::is_change_observer<std::decay_t<C>, derived_type, value_type>::value);
+    }
+
+    template <class D>
+    template <std::size_t I, class C>
+    inline connection xobserved<D>::connect(C&& cb)
+    {
+        using value_type = detail::xproperty_value_type<derived_type, I>;
+        connection res(detail::make_observer_callback<derived_type, I>(std::forward<C>(cb)),
+                       detail::is_change_observer<std::decay_t<C>, derived_type, value_type>::value);
+        observers<I>(p_table).push_back(res.m_node);
+        return res;
+    }
+
+    template <class D>
+    template <std::size_t I, class E, class C>
+    inline void xobserved<D>::observe_async(E& executor, C&& cb)
+    {
+        table(p_table).template observe<xproperty_index_of<derived_type, I>::value>(detail::make_async_observer_callback<derived_type, I>(executor, std::forward<C>(cb)));
+    }
+
     template <class D>
     template <std::size_t I>
-    inline void xobserved<D>::observe(std::function<void(const derived_type&)> cb)
+    inline void xobserved<D>::unobserve()
     {
-        auto position = m_observers.find(I);
-        if(position == m_observers.end())
+        if (p_table)
         {
-            m_observers[I] = { std::move(cb) };
+            std::get<xproperty_index_of<derived_type, I>::value>(p_table->m_observers).clear();
         }
-        else
+    }
+
+    template <class D>
+    template <std::size_t I, class C>
+    inline void xobserved<D>::validate(C&& cb)
+    {
+        std::get<xproperty_index_of<derived_type, I>::value>(table(p_table).m_validators).emplace_back(std::forward<C>(cb));
+    }
+
+    template <class D>
+    template <std::size_t I>
+    inline void xobserved<D>::unvalidate()
+    {
+        if (p_table)
         {
-            position->second.push_back(std::move(cb));
+            std::get<xproperty_index_of<derived_type, I>::value>(p_table->m_validators).clear();
         }
     }
 
+    template <class D>
+    template <std::size_t I, class C>
+    inline void xobserved<D>::observe_all(C&& cb)
+    {
+        using value_type = detail::xproperty_value_type<derived_type, I>;
+        table(p_class_table).template observe<xproperty_index_of<derived_type, I>::value>(detail::make_observer_callback<derived_type, I>(std::forward<C>(cb)),
+                                                                                         detail::is_change_observer<std::decay_t<C>, derived_type, value_type>::value);
+    }
+
+    template <class D>
+    template <std::size_t I, class C>
+    inline connection xobserved<D>::connect_all(C&& cb)
+    {
+        using value_type = detail::xproperty_value_type<derived_type, I>;
+        connection res(detail::make_observer_callback<derived_type, I>(std::forward<C>(cb)),
+                       detail::is_change_observer<std::decay_t<C>, derived_type, value_type>::value);
+        observers<I>(p_class_table).push_back(res.m_node);
+        return res;
+    }
+
     template <class D>
     template <std::size_t I>
-    inline void xobserved<D>::unobserve()
+    inline void xobserved<D>::unobserve_all()
+    {
+        if (p_class_table)
+        {
+            std::get<xproperty_index_of<derived_type, I>::value>(p_class_table->m_observers).clear();
+        }
+    }
+
+    template <class D>
+    template <std::size_t I, class C>
+    inline void xobserved<D>::validate_all(C&& cb)
     {
-        m_observers.erase(I);
+        std::get<xproperty_index_of<derived_type, I>::value>(table(p_class_table).m_validators).emplace_back(std::forward<C>(cb));
     }
 
     template <class D>
-    template <std::size_t I, class V>
-    inline void xobserved<D>::validate(std::function<V(const derived_type&, V)> cb)
+    template <std::size_t I>
+    inline void xobserved<D>::unvalidate_all()
     {
-        auto position = m_validators.find(I);
-        if(position == m_validators.end())
+        if (p_class_table)
         {
-            m_validators[I] = { std::move(cb) };
+            std::get<xproperty_index_of<derived_type, I>::value>(p_class_table->m_validators).clear();
         }
-        else
+    }
+
+    template <class D>
+    template <std::size_t I>
+    inline bool xobserved<D>::requires_old_value() const noexcept
+    {
+        constexpr std::size_t index = xproperty_index_of<derived_type, I>::value;
+        return (p_class_table && std::get<index>(p_class_table->m_observers).requires_old_value()) ||
+               (p_table && std::get<index>(p_table->m_observers).requires_old_value());
+    }
+
+    template <class D>
+    inline auto xobserved<D>::table(std::unique_ptr<table_type>& ptr) -> table_type&
+    {
+        if (!ptr)
         {
-            position->second.push_back(std::move(cb));
+            ptr = std::make_unique<table_type>();
         }
+        return *ptr;
     }
 
     template <class D>
     template <std::size_t I>
-    inline void xobserved<D>::unvalidate()
+    inline auto xobserved<D>::observers(std::unique_ptr<table_type>& ptr) -> observer_list&
+    {
+        return std::get<xproperty_index_of<derived_type, I>::value>(table(ptr).m_observers);
+    }
+
+    template <class D>
+    inline void xobserved<D>::hold_notifications()
+    {
+        ++table(p_table).m_hold_depth;
+    }
+
+    template <class D>
+    inline void xobserved<D>::release_notifications()
+    {
+        if (p_table && p_table->m_hold_depth != 0 && --(p_table->m_hold_depth) == 0)
+        {
+            notify_pending(std::make_index_sequence<xproperty_count<derived_type>::value>());
+        }
+    }
+
+    template <class D>
+    inline void xobserved<D>::track_dirty()
+    {
+        table(p_table);
+    }
+
+    template <class D>
+    inline bool xobserved<D>::dirty() const noexcept
+    {
+        return p_table && p_table->m_dirty.any();
+    }
+
+    template <class D>
+    template <std::size_t I>
+    inline bool xobserved<D>::dirty() const noexcept
+    {
+        return p_table && p_table->m_dirty.test(xproperty_index_of<derived_type, I>::value);
+    }
+
+    template <class D>
+    inline void xobserved<D>::clear_dirty() noexcept
+    {
+        if (p_table)
+        {
+            p_table->m_dirty.clear();
+        }
+    }
+
+    template <class D>
+    template <class F>
+    inline void xobserved<D>::for_each_dirty(F&& f) const
     {
-        m_validators.erase(I);
+        if (p_table)
+        {
+            p_table->m_dirty.for_each([this, &f](std::size_t index) {
+                detail::visit_property(derived_cast(), index, f, std::make_index_sequence<xproperty_count<derived_type>::value>());
+            });
+        }
+    }
+
+    template <class D>
+    inline void xobserved<D>::set_journal(xjournal* journal)
+    {
+        if (journal != nullptr || p_table)
+        {
+            table(p_table).p_journal = journal;
+        }
     }
 
     template <class D>
     template <std::size_t I>
     inline void xobserved<D>::invoke_observers() const
     {
-        auto position = m_observers.find(I);
-        if(position != m_observers.end())
+        constexpr std::size_t index = xproperty_index_of<derived_type, I>::value;
+        detail::invoke_static_observers<I>(derived_cast(), detail::has_static_callbacks<derived_type>());
+        record_change<I>();
+        if (p_table && p_table->m_hold_depth != 0)
         {
-            const auto& callbacks = position->second;
-            for (auto it = callbacks.cbegin(); it != callbacks.cend(); ++it) 
+            p_table->m_pending.set(index);
+            return;
+        }
+        notify<index>();
+    }
+
+    // While notifications are held, the value of the property before the first
+    // assignment is kept for the release.
+
+    template <class D>
+    template <std::size_t I, class T>
+    inline void xobserved<D>::invoke_observers(T&& old_value) const
+    {
+        constexpr std::size_t index = xproperty_index_of<derived_type, I>::value;
+        detail::invoke_static_observers<I>(derived_cast(), detail::has_static_callbacks<derived_type>());
+        record_change<I>();
+        if (p_table && p_table->m_hold_depth != 0)
+        {
+            if (!p_table->m_pending.test(index))
             {
-                it->operator()(derived_cast()); 
+                std::get<index>(p_table->m_old_values).emplace(std::move(old_value));
+                p_table->m_pending.set(index);
             }
+            return;
         }
+        const change<T> c = { old_value, detail::get_property<I>(derived_cast()) };
+        notify<index>(&c);
     }
-    
+
+    template <class D>
+    template <std::size_t I, class T>
+    inline void xobserved<D>::invoke_atomic_observers(const T& new_value) const
+    {
+        constexpr std::size_t index = xproperty_index_of<derived_type, I>::value;
+        detail::invoke_static_observers<I>(derived_cast(), detail::has_static_callbacks<derived_type>());
+        record_change<I>(new_value);
+        notify<index>();
+    }
+
+    template <class D>
+    template <std::size_t I, class T>
+    inline void xobserved<D>::invoke_atomic_observers(const T& old_value, const T& new_value) const
+    {
+        constexpr std::size_t index = xproperty_index_of<derived_type, I>::value;
+        detail::invoke_static_observers<I>(derived_cast(), detail::has_static_callbacks<derived_type>());
+        record_change<I>(new_value);
+        const change<T> c = { old_value, new_value };
+        notify<index>(&c);
+    }
+
+    template <class D>
+    inline bool xobserved<D>::records_changes() const noexcept
+    {
+        return p_table != nullptr;
+    }
+
+    template <class D>
+    template <std::size_t I>
+    inline void xobserved<D>::record_change() const
+    {
+        record_change<I>(detail::get_property<I>(derived_cast()));
+    }
+
     template <class D>
     template <std::size_t I, class V>
-    inline auto xobserved<D>::invoke_validators(V&& v) const
+    inline void xobserved<D>::record_change(const V& value) const
     {
-        auto position = m_validators.find(I);
-        if(position != m_validators.end())
+        if (p_table)
         {
-            const auto& callbacks = position->second;
-            for (auto it = callbacks.cbegin(); it != callbacks.cend(); ++it) 
+            p_table->m_dirty.set(xproperty_index_of<derived_type, I>::value);
+            if (p_table->p_journal != nullptr)
+            {
+                p_table->p_journal->append(&derived_cast(), I, value);
+            }
+        }
+    }
+
+    template <class D>
+    template <std::size_t N>
+    inline void xobserved<D>::notify(const void* change) const
+    {
+        if (p_class_table)
+        {
+            std::get<N>(p_class_table->m_observers).invoke(&derived_cast(), change);
+        }
+        if (p_table)
+        {
+            std::get<N>(p_table->m_observers).invoke(&derived_cast(), change);
+        }
+    }
+
+    // When observers throw, the other pending properties are still notified, then
+    // the first exception is rethrown.
+
+    template <class D>
+    template <std::size_t... N>
+    inline void xobserved<D>::notify_pending(std::index_sequence<N...>)
+    {
+        std::exception_ptr error;
+        auto flush = [this, &error](auto index) {
+            constexpr std::size_t n = decltype(index)::value;
+            if (p_table->m_pending.test(n))
             {
-                v = linb::any_cast<std::function<V(const derived_type&, V)>>(*it)(derived_cast(), std::forward<V>(v));
+                p_table->m_pending.reset(n);
+                try
+                {
+                    auto& old_value = std::get<n>(p_table->m_old_values);
+                    if (old_value.has_value())
+                    {
+                        using value_type = typename xproperty_type<derived_type, n>::value_type;
+                        const value_type previous(std::move(old_value.value()));
+                        old_value.reset();
+                        const change<value_type> c = { previous, detail::get_property<xproperty_type<derived_type, n>::offset()>(derived_cast()) };
+                        notify<n>(&c);
+                    }
+                    else
+                    {
+                        notify<n>();
+                    }
+                }
+                catch (...)
+                {
+                    if (!error)
+                    {
+                        error = std::current_exception();
+                    }
+                }
             }
+            return 0;
+        };
+        int dummy[] = { 0, flush(detail::index_constant<N>())... };
+        (void)dummy;
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    template <class D>
+    template <std::size_t I, class V>
+    inline auto xobserved<D>::invoke_validators(V&& v) const
+    {
+        constexpr std::size_t index = xproperty_index_of<derived_type, I>::value;
+        detail::xproperty_value_type<derived_type, I> proposal(std::forward<V>(v));
+        detail::invoke_static_validators<I>(derived_cast(), proposal, detail::has_static_callbacks<derived_type>());
+        if (p_class_table)
+        {
+            p_class_table->template validate<index>(derived_cast(), proposal);
+        }
+        if (p_table)
+        {
+            p_table->template validate<index>(derived_cast(), proposal);
+        }
+        return proposal;
+    }
+
+    /*************************************
+     * xnotification_hold implementation *
+     *************************************/
+
+    template <class D>
+    inline xnotification_hold<D>::xnotification_hold(xobserved<D>& owner)
+        : p_owner(&owner)
+    {
+        p_owner->hold_notifications();
+    }
+
+    template <class D>
+    inline xnotification_hold<D>::~xnotification_hold()
+    {
+        try
+        {
+            release();
+        }
+        catch (...)
+        {
         }
-        return v;
     }
 
+    template <class D>
+    inline xnotification_hold<D>::xnotification_hold(xnotification_hold&& rhs) noexcept
+        : p_owner(rhs.p_owner)
+    {
+        rhs.p_owner = nullptr;
+    }
+
+    template <class D>
+    inline void xnotification_hold<D>::release()
+    {
+        if (p_owner != nullptr)
+        {
+            xobserved<D>* owner = p_owner;
+            p_owner = nullptr;
+            owner->release_notifications();
+        }
+    }
+
+    template <class D>
+    inline xnotification_hold<D> hold_notifications(xobserved<D>& owner)
+    {
+        return xnotification_hold<D>(owner);
+    }
 }
 
 #endif
-
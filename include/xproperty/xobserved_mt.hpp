@@ -0,0 +1,595 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XOBSERVED_MT_HPP
+#define XOBSERVED_MT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "xinplace_function.hpp"
+#include "xobserved.hpp"
+#include "xproperty.hpp"
+
+namespace xp
+{
+    namespace detail
+    {
+        /*****************
+         * xmt_callbacks *
+         *****************/
+
+        // Immutable snapshot of the observers and validators of a property. Registering
+        // a callback publishes a new snapshot, readers never see a snapshot change.
+
+        template <class D, class T>
+        struct xmt_callbacks
+        {
+            using observer_type = xinplace_function<void(const void*, const void*)>;
+            using validator_type = xinplace_function<T(const D&, T)>;
+
+            bool empty() const noexcept;
+
+            std::vector<observer_type> m_observers;
+            std::vector<validator_type> m_validators;
+            std::size_t m_old_value_count = 0;
+        };
+
+        template <class D, class S>
+        struct xmt_slots;
+
+        template <class D, std::size_t... I>
+        struct xmt_slots<D, std::index_sequence<I...>>
+        {
+            template <std::size_t J>
+            using callbacks_type = xmt_callbacks<D, typename xproperty_type<D, J>::value_type>;
+
+            using type = std::tuple<std::atomic<const callbacks_type<I>*>...>;
+        };
+
+        /**********************
+         * xobserved_mt_table *
+         **********************/
+
+        // Current snapshots of an owner, one per property, null while the property
+        // has no callback. Writers are serialized by a mutex that readers only ever
+        // try to lock.
+        //
+        // Readers are counted per epoch parity. Snapshots replaced during an epoch
+        // are retired with it when the epoch advances, which waits for the readers
+        // of the epoch before; they are deleted once the readers of their own epoch
+        // have left, by the next writer or by the last of these readers. Readers
+        // entering after the advance are counted in the other parity, so steady
+        // reader traffic does not hold back the reclamation.
+
+        template <class D>
+        class xobserved_mt_table
+        {
+        public:
+
+            xobserved_mt_table() = default;
+            ~xobserved_mt_table();
+
+            // Copies the snapshots current at the time of the copy.
+            xobserved_mt_table(const xobserved_mt_table& rhs);
+            xobserved_mt_table& operator=(const xobserved_mt_table&) = delete;
+
+            template <std::size_t N>
+            auto snapshot() const noexcept;
+
+            // Returns the parity to pass to leave.
+            std::size_t enter() const noexcept;
+            void leave(std::size_t parity) const noexcept;
+
+            template <std::size_t N, class F>
+            void update(F&& f);
+
+        private:
+
+            struct retired
+            {
+                const void* p_snapshot;
+                void (*p_delete)(const void*);
+            };
+
+            template <std::size_t... N>
+            void copy_slots(const xobserved_mt_table& rhs, std::index_sequence<N...>);
+
+            template <std::size_t... N>
+            void delete_slots(std::index_sequence<N...>) noexcept;
+
+            static void delete_retired(std::vector<retired>& snapshots) noexcept;
+
+            void reclaim() noexcept;
+
+            using slots_type = typename xmt_slots<D, std::make_index_sequence<xproperty_count<D>::value>>::type;
+
+            slots_type m_slots;
+            mutable std::atomic<std::size_t> m_readers[2] = { { 0 }, { 0 } };
+            std::atomic<std::size_t> m_epoch = { 0 };
+            mutable std::atomic<bool> m_has_retired = { false };
+            mutable std::mutex m_mutex;
+            // Replaced during the current epoch.
+            std::vector<retired> m_retired;
+            // Replaced during the previous epoch, waiting for its readers.
+            std::vector<retired> m_draining;
+        };
+
+        // Marks a reader in flight for the lifetime of the guard.
+
+        template <class D>
+        class xmt_read_guard
+        {
+        public:
+
+            explicit xmt_read_guard(const xobserved_mt_table<D>& table) noexcept;
+            ~xmt_read_guard();
+
+            xmt_read_guard(const xmt_read_guard&) = delete;
+            xmt_read_guard& operator=(const xmt_read_guard&) = delete;
+
+        private:
+
+            const xobserved_mt_table<D>& m_table;
+            std::size_t m_parity;
+        };
+    }
+
+    /****************************
+     * xobserved_mt declaration *
+     ****************************/
+
+    // Variant of xobserved whose callbacks can be registered and removed while other
+    // threads assign the properties. Assignments read immutable snapshots of the
+    // callbacks and never block on registration. Type-level callbacks, connections
+    // and notification holds are not available.
+    //
+    // Concurrent assignments of the same property are not synchronized.
+
+    template <class D>
+    class xobserved_mt
+    {
+    public:
+
+        using derived_type = D;
+
+        derived_type& derived_cast() noexcept;
+        const derived_type& derived_cast() const noexcept;
+
+        template <std::size_t I, class C>
+        void observe(C&& cb);
+
+        template <std::size_t I>
+        void unobserve();
+
+        template <std::size_t I, class C>
+        void validate(C&& cb);
+
+        template <std::size_t I>
+        void unvalidate();
+
+        // Always true: whether an observer needs the previous value is decided on
+        // the snapshot notified, which may be published after the assignment starts.
+        template <std::size_t I>
+        bool requires_old_value() const noexcept;
+
+    protected:
+
+        xobserved_mt() = default;
+        ~xobserved_mt();
+
+        xobserved_mt(const xobserved_mt& rhs);
+        xobserved_mt& operator=(const xobserved_mt& rhs);
+
+        xobserved_mt(xobserved_mt&& rhs) noexcept;
+        xobserved_mt& operator=(xobserved_mt&& rhs) noexcept;
+
+    private:
+
+        using table_type = detail::xobserved_mt_table<derived_type>;
+
+        // Null until the first callback is registered, published with a CAS.
+        std::atomic<table_type*> p_table = { nullptr };
+
+        template <class X, class Y, class Z>
+        friend class xproperty;
+
+        template <class X, class Y, class Z>
+        friend class xatomic_property;
+
+        friend struct detail::xproperty_access;
+
+        table_type& table();
+
+        template <std::size_t I>
+        void invoke_observers() const;
+
+        template <std::size_t I, class T>
+        void invoke_observers(T&& old_value) const;
+
+        // Atomic properties pass the value they stored, see xobserved.
+        template <std::size_t I, class T>
+        void invoke_atomic_observers(const T& new_value) const;
+
+        template <std::size_t I, class T>
+        void invoke_atomic_observers(const T& old_value, const T& new_value) const;
+
+        template <std::size_t I, class V>
+        auto invoke_validators(V&& r) const;
+    };
+
+    template <class E>
+    using is_xobserved_mt = std::is_base_of<xobserved_mt<E>, E>;
+
+    /********************************
+     * xmt_callbacks implementation *
+     ********************************/
+
+    namespace detail
+    {
+        template <class D, class T>
+        inline bool xmt_callbacks<D, T>::empty() const noexcept
+        {
+            return m_observers.empty() && m_validators.empty();
+        }
+
+        /*************************************
+         * xobserved_mt_table implementation *
+         *************************************/
+
+        template <class D>
+        inline xobserved_mt_table<D>::~xobserved_mt_table()
+        {
+            delete_slots(std::make_index_sequence<xproperty_count<D>::value>());
+            delete_retired(m_retired);
+            delete_retired(m_draining);
+        }
+
+        template <class D>
+        inline xobserved_mt_table<D>::xobserved_mt_table(const xobserved_mt_table& rhs)
+        {
+            // Snapshots are only deleted under the mutex.
+            std::lock_guard<std::mutex> lock(rhs.m_mutex);
+            copy_slots(rhs, std::make_index_sequence<xproperty_count<D>::value>());
+        }
+
+        template <class D>
+        template <std::size_t N>
+        inline auto xobserved_mt_table<D>::snapshot() const noexcept
+        {
+            return std::get<N>(m_slots).load(std::memory_order_seq_cst);
+        }
+
+        // A reader counted in a stale parity only delays the reclamation: that
+        // parity has to drain before the epoch advances again.
+        template <class D>
+        inline std::size_t xobserved_mt_table<D>::enter() const noexcept
+        {
+            std::size_t parity = m_epoch.load(std::memory_order_seq_cst) & 1;
+            m_readers[parity].fetch_add(1, std::memory_order_seq_cst);
+            return parity;
+        }
+
+        template <class D>
+        inline void xobserved_mt_table<D>::leave(std::size_t parity) const noexcept
+        {
+            if (m_readers[parity].fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+                m_has_retired.load(std::memory_order_seq_cst) &&
+                m_mutex.try_lock())
+            {
+                const_cast<xobserved_mt_table*>(this)->reclaim();
+                m_mutex.unlock();
+            }
+        }
+
+        // Publishes a modified copy of the snapshot of the N-th property.
+        template <class D>
+        template <std::size_t N, class F>
+        inline void xobserved_mt_table<D>::update(F&& f)
+        {
+            using callbacks_type = typename xmt_slots<D, std::make_index_sequence<xproperty_count<D>::value>>::template callbacks_type<N>;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& slot = std::get<N>(m_slots);
+            const callbacks_type* current = slot.load(std::memory_order_relaxed);
+            std::unique_ptr<callbacks_type> next = current ? std::make_unique<callbacks_type>(*current) : std::make_unique<callbacks_type>();
+            f(*next);
+            m_retired.reserve(m_retired.size() + 1);
+            slot.store(next->empty() ? nullptr : next.release(), std::memory_order_seq_cst);
+            if (current != nullptr)
+            {
+                m_retired.push_back({ current, [](const void* p) { delete static_cast<const callbacks_type*>(p); } });
+                m_has_retired.store(true, std::memory_order_seq_cst);
+            }
+            reclaim();
+        }
+
+        // Readers entering after the publication of a snapshot cannot load the
+        // snapshots it replaced, and are counted in the parity of an epoch that
+        // started after the replacement.
+        template <class D>
+        inline void xobserved_mt_table<D>::reclaim() noexcept
+        {
+            std::size_t epoch = m_epoch.load(std::memory_order_relaxed);
+            if (m_readers[(epoch + 1) & 1].load(std::memory_order_seq_cst) == 0)
+            {
+                delete_retired(m_draining);
+                if (!m_retired.empty())
+                {
+                    m_epoch.store(epoch + 1, std::memory_order_seq_cst);
+                    m_draining.swap(m_retired);
+                    if (m_readers[epoch & 1].load(std::memory_order_seq_cst) == 0)
+                    {
+                        delete_retired(m_draining);
+                    }
+                }
+            }
+            m_has_retired.store(!m_retired.empty() || !m_draining.empty(), std::memory_order_seq_cst);
+        }
+
+        template <class D>
+        inline void xobserved_mt_table<D>::delete_retired(std::vector<retired>& snapshots) noexcept
+        {
+            for (const retired& r : snapshots)
+            {
+                r.p_delete(r.p_snapshot);
+            }
+            snapshots.clear();
+        }
+
+        template <class D>
+        template <std::size_t... N>
+        inline void xobserved_mt_table<D>::copy_slots(const xobserved_mt_table& rhs, std::index_sequence<N...>)
+        {
+            auto copy = [](auto& slot, const auto& rhs_slot) {
+                using callbacks_type = std::remove_const_t<std::remove_pointer_t<decltype(rhs_slot.load())>>;
+                const callbacks_type* p = rhs_slot.load(std::memory_order_relaxed);
+                slot.store(p ? new callbacks_type(*p) : nullptr, std::memory_order_relaxed);
+                return 0;
+            };
+            int dummy[] = { 0, copy(std::get<N>(m_slots), std::get<N>(rhs.m_slots))... };
+            (void)dummy;
+        }
+
+        template <class D>
+        template <std::size_t... N>
+        inline void xobserved_mt_table<D>::delete_slots(std::index_sequence<N...>) noexcept
+        {
+            int dummy[] = { 0, (delete std::get<N>(m_slots).load(std::memory_order_relaxed), 0)... };
+            (void)dummy;
+        }
+
+        /*********************************
+         * xmt_read_guard implementation *
+         *********************************/
+
+        template <class D>
+        inline xmt_read_guard<D>::xmt_read_guard(const xobserved_mt_table<D>& table) noexcept
+            : m_table(table), m_parity(table.enter())
+        {
+        }
+
+        template <class D>
+        inline xmt_read_guard<D>::~xmt_read_guard()
+        {
+            m_table.leave(m_parity);
+        }
+    }
+
+    /*******************************
+     * xobserved_mt implementation *
+     *******************************/
+
+    template <class D>
+    inline xobserved_mt<D>::~xobserved_mt()
+    {
+        delete p_table.load(std::memory_order_relaxed);
+    }
+
+    template <class D>
+    inline xobserved_mt<D>::xobserved_mt(const xobserved_mt& rhs)
+    {
+        const table_type* t = rhs.p_table.load(std::memory_order_acquire);
+        p_table.store(t ? new table_type(*t) : nullptr, std::memory_order_relaxed);
+    }
+
+    template <class D>
+    inline auto xobserved_mt<D>::operator=(const xobserved_mt& rhs) -> xobserved_mt&
+    {
+        if (this != &rhs)
+        {
+            const table_type* t = rhs.p_table.load(std::memory_order_acquire);
+            delete p_table.exchange(t ? new table_type(*t) : nullptr, std::memory_order_acq_rel);
+        }
+        return *this;
+    }
+
+    template <class D>
+    inline xobserved_mt<D>::xobserved_mt(xobserved_mt&& rhs) noexcept
+        : p_table(rhs.p_table.exchange(nullptr, std::memory_order_acq_rel))
+    {
+    }
+
+    template <class D>
+    inline auto xobserved_mt<D>::operator=(xobserved_mt&& rhs) noexcept -> xobserved_mt&
+    {
+        if (this != &rhs)
+        {
+            delete p_table.exchange(rhs.p_table.exchange(nullptr, std::memory_order_acq_rel), std::memory_order_acq_rel);
+        }
+        return *this;
+    }
+
+    template <class D>
+    inline auto xobserved_mt<D>::derived_cast() noexcept -> derived_type&
+    {
+        return *static_cast<derived_type*>(this);
+    }
+
+    template <class D>
+    inline auto xobserved_mt<D>::derived_cast() const noexcept -> const derived_type&
+    {
+        return *static_cast<const derived_type*>(this);
+    }
+
+    template <class D>
+    template <std::size_t I, class C>
+    inline void xobserved_mt<D>::observe(C&& cb)
+    {
+        using value_type = detail::xproperty_value_type<derived_type, I>;
+        constexpr bool needs_old = detail::is_change_observer<std::decay_t<C>, derived_type, value_type>::value;
+        auto callback = detail::make_observer_callback<derived_type, I>(std::forward<C>(cb));
+        table().template update<xproperty_index_of<derived_type, I>::value>([&callback, needs_old](auto& callbacks) {
+            callbacks.m_observers.emplace_back(std::move(callback));
+            callbacks.m_old_value_count += needs_old ? 1 : 0;
+        });
+    }
+
+    template <class D>
+    template <std::size_t I>
+    inline void xobserved_mt<D>::unobserve()
+    {
+        if (table_type* t = p_table.load(std::memory_order_acquire))
+        {
+            t->template update<xproperty_index_of<derived_type, I>::value>([](auto& callbacks) {
+                callbacks.m_observers.clear();
+                callbacks.m_old_value_count = 0;
+            });
+        }
+    }
+
+    template <class D>
+    template <std::size_t I, class C>
+    inline void xobserved_mt<D>::validate(C&& cb)
+    {
+        auto&& callback = std::forward<C>(cb);
+        table().template update<xproperty_index_of<derived_type, I>::value>([&callback](auto& callbacks) {
+            callbacks.m_validators.emplace_back(std::forward<C>(callback));
+        });
+    }
+
+    template <class D>
+    template <std::size_t I>
+    inline void xobserved_mt<D>::unvalidate()
+    {
+        if (table_type* t = p_table.load(std::memory_order_acquire))
+        {
+            t->template update<xproperty_index_of<derived_type, I>::value>([](auto& callbacks) {
+                callbacks.m_validators.clear();
+            });
+        }
+    }
+
+    template <class D>
+    template <std::size_t I>
+    inline bool xobserved_mt<D>::requires_old_value() const noexcept
+    {
+        return true;
+    }
+
+    template <class D>
+    inline auto xobserved_mt<D>::table() -> table_type&
+    {
+        table_type* t = p_table.load(std::memory_order_acquire);
+        if (t == nullptr)
+        {
+            std::unique_ptr<table_type> created = std::make_unique<table_type>();
+            if (p_table.compare_exchange_strong(t, created.get(), std::memory_order_acq_rel))
+            {
+                t = created.release();
+            }
+        }
+        return *t;
+    }
+
+    template <class D>
+    template <std::size_t I>
+    inline void xobserved_mt<D>::invoke_observers() const
+    {
+        if (const table_type* t = p_table.load(std::memory_order_acquire))
+        {
+            detail::xmt_read_guard<derived_type> guard(*t);
+            if (const auto* callbacks = t->template snapshot<xproperty_index_of<derived_type, I>::value>())
+            {
+                for (const auto& cb : callbacks->m_observers)
+                {
+                    cb(&derived_cast(), nullptr);
+                }
+            }
+        }
+    }
+
+    template <class D>
+    template <std::size_t I, class T>
+    inline void xobserved_mt<D>::invoke_observers(T&& old_value) const
+    {
+        if (const table_type* t = p_table.load(std::memory_order_acquire))
+        {
+            detail::xmt_read_guard<derived_type> guard(*t);
+            if (const auto* callbacks = t->template snapshot<xproperty_index_of<derived_type, I>::value>())
+            {
+                const change<T> c = { old_value, detail::get_property<I>(derived_cast()) };
+                const change<T>* p = callbacks->m_old_value_count != 0 ? &c : nullptr;
+                for (const auto& cb : callbacks->m_observers)
+                {
+                    cb(&derived_cast(), p);
+                }
+            }
+        }
+    }
+
+    template <class D>
+    template <std::size_t I, class T>
+    inline void xobserved_mt<D>::invoke_atomic_observers(const T&) const
+    {
+        invoke_observers<I>();
+    }
+
+    template <class D>
+    template <std::size_t I, class T>
+    inline void xobserved_mt<D>::invoke_atomic_observers(const T& old_value, const T& new_value) const
+    {
+        if (const table_type* t = p_table.load(std::memory_order_acquire))
+        {
+            detail::xmt_read_guard<derived_type> guard(*t);
+            if (const auto* callbacks = t->template snapshot<xproperty_index_of<derived_type, I>::value>())
+            {
+                const change<T> c = { old_value, new_value };
+                for (const auto& cb : callbacks->m_observers)
+                {
+                    cb(&derived_cast(), &c);
+                }
+            }
+        }
+    }
+
+    template <class D>
+    template <std::size_t I, class V>
+    inline auto xobserved_mt<D>::invoke_validators(V&& v) const
+    {
+        detail::xproperty_value_type<derived_type, I> proposal(std::forward<V>(v));
+        if (const table_type* t = p_table.load(std::memory_order_acquire))
+        {
+            detail::xmt_read_guard<derived_type> guard(*t);
+            if (const auto* callbacks = t->template snapshot<xproperty_index_of<derived_type, I>::value>())
+            {
+                for (const auto& cb : callbacks->m_validators)
+                {
+                    proposal = cb(derived_cast(), std::move(proposal));
+                }
+            }
+        }
+        return proposal;
+    }
+}
+
+#endif
@@ -0,0 +1,307 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPATCH_HPP
+#define XPATCH_HPP
+
+#include <cstddef>
+#include <exception>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "xdelta.hpp"
+#include "xobserved.hpp"
+#include "xproperty.hpp"
+
+namespace xp
+{
+
+    // XPATCH(patch, Attribute, Value)
+    // Sets the proposal of the patch for the specified attribute of its owner type.
+
+    #define XPATCH(P, A, V) \
+    P.set<xoffsetof(decltype(P)::owner_type, A)>(V);
+
+    namespace detail
+    {
+        template <class O, class S>
+        struct xpatch_values;
+
+        template <class O, std::size_t... I>
+        struct xpatch_values<O, std::index_sequence<I...>>
+        {
+            using type = std::tuple<xoptional<typename xproperty_type<O, I>::value_type>...>;
+        };
+    }
+
+    /**********************
+     * xpatch declaration *
+     **********************/
+
+    // Proposals for several properties of an owner, applied at once by apply_patch.
+    // Setting a property twice replaces its proposal.
+
+    template <class O>
+    class xpatch
+    {
+    public:
+
+        using owner_type = O;
+
+        xpatch() = default;
+
+        xpatch(const xpatch&) = delete;
+        xpatch& operator=(const xpatch&) = delete;
+
+        template <std::size_t I, class V>
+        void set(V&& value);
+
+        bool empty() const noexcept;
+        void clear() noexcept;
+
+    private:
+
+        using values_type = typename detail::xpatch_values<O, std::make_index_sequence<xproperty_count<O>::value>>::type;
+
+        template <std::size_t... J>
+        void clear(std::index_sequence<J...>) noexcept;
+
+        values_type m_values;
+        detail::xbitmask<xproperty_count<O>::value> m_proposed;
+
+        template <class X>
+        friend void apply_patch(X& owner, xpatch<X>& patch);
+    };
+
+    // apply_patch(owner, patch)
+    //
+    // Assigns the proposals of the patch to the properties of the owner in three passes:
+    // all the proposals are validated, then stored, then the observers of each assigned
+    // property are invoked once, so that they see the whole patch applied. When a
+    // validator throws, the owner is left unchanged. When storing a value throws, the
+    // values stored so far are swapped back. When observers throw, the patch remains
+    // applied and all the assigned properties are still notified, then the first
+    // exception is rethrown. The patch is cleared in any case.
+    //
+    // Proposals of equality-gated properties which are equal to the current values are
+    // skipped, like upon assignment.
+
+    template <class O>
+    void apply_patch(O& owner, xpatch<O>& patch);
+
+    // decode_patch(patch, data, size)
+    //
+    // Sets the proposals of the patch from the delta record starting at `data`, see
+    // decode_delta. Returns the size of the record.
+
+    template <class O>
+    std::size_t decode_patch(xpatch<O>& patch, const char* data, std::size_t size);
+
+    /*************************
+     * xpatch implementation *
+     *************************/
+
+    template <class O>
+    template <std::size_t I, class V>
+    inline void xpatch<O>::set(V&& value)
+    {
+        constexpr std::size_t index = xproperty_index_of<O, I>::value;
+        using value_type = typename xproperty_type<O, index>::value_type;
+        std::get<index>(m_values).emplace(detail::as_proposal<value_type>(std::forward<V>(value)));
+        m_proposed.set(index);
+    }
+
+    template <class O>
+    inline bool xpatch<O>::empty() const noexcept
+    {
+        return !m_proposed.any();
+    }
+
+    template <class O>
+    inline void xpatch<O>::clear() noexcept
+    {
+        clear(std::make_index_sequence<xproperty_count<O>::value>());
+    }
+
+    template <class O>
+    template <std::size_t... J>
+    inline void xpatch<O>::clear(std::index_sequence<J...>) noexcept
+    {
+        int dummy[] = { 0, (std::get<J>(m_values).reset(), 0)... };
+        (void)dummy;
+        m_proposed.clear();
+    }
+
+    /******************************
+     * apply_patch implementation *
+     ******************************/
+
+    namespace detail
+    {
+        template <class O>
+        class xpatch_guard
+        {
+        public:
+
+            explicit xpatch_guard(xpatch<O>& patch) noexcept
+                : m_patch(patch)
+            {
+            }
+
+            ~xpatch_guard()
+            {
+                m_patch.clear();
+            }
+
+            xpatch_guard(const xpatch_guard&) = delete;
+            xpatch_guard& operator=(const xpatch_guard&) = delete;
+
+        private:
+
+            xpatch<O>& m_patch;
+        };
+
+        // Validates the proposals, without modifying the owner.
+
+        template <class O, class V, class B, std::size_t... J>
+        inline void validate_patch(O& owner, V& values, B& proposed, std::index_sequence<J...>)
+        {
+            auto validate = [&owner, &values, &proposed](auto index) {
+                constexpr std::size_t j = decltype(index)::value;
+                using property_type = xproperty_type<O, j>;
+                if (proposed.test(j))
+                {
+                    auto& proposal = std::get<j>(values).value();
+                    const property_type& property = property_at<j>(static_cast<const O&>(owner));
+                    if (xproperty_gate<typename property_type::comparator_type>::unchanged(static_cast<typename property_type::const_reference>(property), proposal))
+                    {
+                        proposed.reset(j);
+                    }
+                    else
+                    {
+                        xproperty_access::validate<property_type>(owner, proposal);
+                    }
+                }
+                return 0;
+            };
+            int validated[] = { 0, validate(index_constant<J>())... };
+            (void)validated;
+        }
+
+        // Swaps the proposals with the values of the properties, swapping them back if one
+        // of the swaps throws, then invokes the observers of each property with its previous
+        // value, now held by `values`, rethrowing the first exception once all the properties
+        // are notified. Without notification, the properties are still
+        // marked as dirty and journaled.
+
+        template <class O, class V, class B, std::size_t... J>
+        inline void commit_patch(O& owner, V& values, const B& proposed, bool notify, std::index_sequence<J...>)
+        {
+            std::size_t stored = 0;
+            auto store = [&owner, &values, &proposed, &stored](auto index, std::size_t count) {
+                constexpr std::size_t j = decltype(index)::value;
+                if (proposed.test(j) && stored != count)
+                {
+                    xproperty_access::exchange(property_at<j>(owner), std::get<j>(values).value());
+                    ++stored;
+                }
+                return 0;
+            };
+            try
+            {
+                int swapped[] = { 0, store(index_constant<J>(), std::size_t(-1))... };
+                (void)swapped;
+            }
+            catch (...)
+            {
+                std::size_t count = stored;
+                stored = 0;
+                int swapped[] = { 0, store(index_constant<J>(), count)... };
+                (void)swapped;
+                throw;
+            }
+
+            if (notify)
+            {
+                std::exception_ptr error;
+                auto invoke = [&owner, &values, &proposed, &error](auto index) {
+                    constexpr std::size_t j = decltype(index)::value;
+                    if (proposed.test(j))
+                    {
+                        try
+                        {
+                            xproperty_access::notify<xproperty_type<O, j>>(owner, std::get<j>(values).value());
+                        }
+                        catch (...)
+                        {
+                            if (!error)
+                            {
+                                error = std::current_exception();
+                            }
+                        }
+                    }
+                    return 0;
+                };
+                int notified[] = { 0, invoke(index_constant<J>())... };
+                (void)notified;
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
+            }
+            else
+            {
+                auto record = [&owner, &proposed](auto index) {
+                    constexpr std::size_t j = decltype(index)::value;
+                    if (proposed.test(j))
+                    {
+                        xproperty_access::record<xproperty_type<O, j>>(owner);
+                    }
+                    return 0;
+                };
+                int recorded[] = { 0, record(index_constant<J>())... };
+                (void)recorded;
+            }
+        }
+
+        template <class O, std::size_t I>
+        inline void decode_patch_value(xpatch<O>& patch, const char* data, std::size_t size)
+        {
+            using property_type = xproperty_type<O, I>;
+            patch.template set<property_type::offset()>(xdelta_codec<typename property_type::value_type>::read(data, size));
+        }
+
+        template <class O, std::size_t... I>
+        inline void decode_patch_entry(xpatch<O>& patch, std::size_t index, const char* data, std::size_t size, std::index_sequence<I...>)
+        {
+            // The leading null pointer keeps the table non-empty for owners without properties.
+            using decoder_type = void (*)(xpatch<O>&, const char*, std::size_t);
+            static constexpr decoder_type decoders[] = { nullptr, &decode_patch_value<O, I>... };
+            decoders[index + 1](patch, data, size);
+        }
+    }
+
+    template <class O>
+    inline void apply_patch(O& owner, xpatch<O>& patch)
+    {
+        detail::xpatch_guard<O> guard(patch);
+        detail::validate_patch(owner, patch.m_values, patch.m_proposed, std::make_index_sequence<xproperty_count<O>::value>());
+        detail::commit_patch(owner, patch.m_values, patch.m_proposed, true, std::make_index_sequence<xproperty_count<O>::value>());
+    }
+
+    template <class O>
+    inline std::size_t decode_patch(xpatch<O>& patch, const char* data, std::size_t size)
+    {
+        return detail::for_each_delta_entry<xproperty_count<O>::value>(data, size, [&patch](std::size_t index, const char* value, std::size_t value_size) {
+            detail::decode_patch_entry(patch, index, value, value_size, std::make_index_sequence<xproperty_count<O>::value>());
+        });
+    }
+}
+
+#endif
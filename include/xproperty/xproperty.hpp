@@ -9,13 +9,258 @@
 #ifndef XPROPERTY_HPP
 #define XPROPERTY_HPP
 
+#include <array>
 #include <type_traits>
 #include <cstddef>
+#include <functional>
+#include <utility>
+
+#include "xproperty_config.hpp"
 
 #define xoffsetof(st, m) offsetof(st, m)
 
 namespace xp
 {
+    namespace detail
+    {
+        template <class... T>
+        struct make_void
+        {
+            using type = void;
+        };
+
+        template <class... T>
+        using void_t = typename make_void<T...>::type;
+
+        template <std::size_t N>
+        using index_constant = std::integral_constant<std::size_t, N>;
+
+        // Properties are numbered at compile time by the XPROPERTY macro. Each property
+        // declares an `xproperty_index` overload taking `index_tag<I + 1>` in its owner,
+        // and since `index_tag<N>` derives from `index_tag<N - 1>`, overload resolution
+        // on `index_tag<XPROPERTY_MAX_PROPERTIES>` selects the last declared overload.
+
+        template <std::size_t N>
+        struct index_tag : index_tag<N - 1>
+        {
+        };
+
+        template <>
+        struct index_tag<0>
+        {
+        };
+
+        // Found by argument-dependent lookup for the first property of an owner.
+        index_constant<0> xproperty_index(index_tag<0>);
+
+        // Each property also declares an `xproperty_at` overload taking its `property_slot`,
+        // and records the property declared before it, possibly in a base class of the
+        // owner, whose overloads are hidden by those of the owner. The properties of an
+        // owner are found by walking back this chain from the last one.
+
+        template <std::size_t I>
+        struct property_slot
+        {
+        };
+
+        struct xproperty_none
+        {
+            static constexpr std::size_t index() noexcept
+            {
+                return std::size_t(-1);
+            }
+        };
+
+        // Found by argument-dependent lookup for the first property of an owner.
+        template <std::size_t I>
+        xproperty_none xproperty_at(property_slot<I>);
+
+        template <class P, std::size_t I, bool = (P::index() == I)>
+        struct xproperty_find
+        {
+            using type = P;
+        };
+
+        template <class P, std::size_t I>
+        struct xproperty_find<P, I, false> : xproperty_find<typename P::previous_property, I>
+        {
+        };
+
+        template <std::size_t I>
+        struct xproperty_find<xproperty_none, I, false>
+        {
+            static_assert(I != I, "property index out of range");
+        };
+
+        // Static observers and validators are numbered per property: XOBSERVE_STATIC and
+        // XVALIDATE_STATIC specialize a slot, a member class template of the owner, for
+        // each of them, and the number of callbacks is the number of consecutive complete
+        // slots. Each count is instantiated with its own tag, so that it sees the slots
+        // specialized before it.
+
+        template <class O, std::size_t Offset>
+        struct xstatic_observer_slots
+        {
+            template <std::size_t K>
+            using slot = typename O::template xstatic_observer_slot<Offset, K>;
+        };
+
+        template <class O, std::size_t Offset>
+        struct xstatic_validator_slots
+        {
+            template <std::size_t K>
+            using slot = typename O::template xstatic_validator_slot<Offset, K>;
+        };
+
+        template <class S, class Tag, std::size_t K = 0, class = void>
+        struct xstatic_count : index_constant<K>
+        {
+        };
+
+        template <class S, class Tag, std::size_t K>
+        struct xstatic_count<S, Tag, K, void_t<decltype(sizeof(typename S::template slot<K>))>>
+            : xstatic_count<S, Tag, K + 1>
+        {
+        };
+
+        template <class O, class = void>
+        struct has_static_callbacks : std::false_type
+        {
+        };
+
+        template <class O>
+        struct has_static_callbacks<O, void_t<decltype(&O::template xstatic_observer<0, 0>)>> : std::true_type
+        {
+        };
+
+        template <class O, class = void>
+        struct xproperty_count_impl : index_constant<0>
+        {
+        };
+
+        template <class O>
+        struct xproperty_count_impl<O, void_t<decltype(O::xproperty_index(index_tag<XPROPERTY_MAX_PROPERTIES>()))>>
+            : decltype(O::xproperty_index(index_tag<XPROPERTY_MAX_PROPERTIES>()))
+        {
+        };
+    }
+
+    /********************
+     * xproperty traits *
+     ********************/
+
+    // xproperty_count<Owner>
+    //
+    // Number of properties declared with XPROPERTY in the owner type.
+
+    template <class O>
+    struct xproperty_count : detail::xproperty_count_impl<O>
+    {
+    };
+
+    // xproperty_type<Owner, Index>
+    //
+    // Type of the property of the owner with the specified compile-time index.
+
+    template <class O, std::size_t I>
+    using xproperty_type = typename detail::xproperty_find<decltype(O::xproperty_at(detail::property_slot<xproperty_count<O>::value - 1>())), I>::type;
+
+    namespace detail
+    {
+        template <class O, std::size_t Offset, std::size_t I, bool = (I < xproperty_count<O>::value)>
+        struct xproperty_index_of_impl
+            : std::conditional_t<xproperty_type<O, I>::offset() == Offset,
+                                 index_constant<I>,
+                                 xproperty_index_of_impl<O, Offset, I + 1>>
+        {
+        };
+
+        template <class O, std::size_t Offset, std::size_t I>
+        struct xproperty_index_of_impl<O, Offset, I, false>
+        {
+            static_assert(I != I, "no property of the owner lies at the specified offset");
+        };
+    }
+
+    // xproperty_index_of<Owner, Offset>
+    //
+    // Compile-time index of the property of the owner located at the specified offset.
+
+    template <class O, std::size_t Offset>
+    struct xproperty_index_of : detail::xproperty_index_of_impl<O, Offset, 0>
+    {
+    };
+
+    // xproperty_descriptor
+    //
+    // Name, offset and compile-time index of a property, see xproperty_descriptors.
+
+    struct xproperty_descriptor
+    {
+        const char* name;
+        std::size_t offset;
+        std::size_t index;
+    };
+
+    namespace detail
+    {
+        // Equality gate of a property: C is the comparator of gated properties,
+        // void for properties that always go through validation and notification.
+
+        template <class C>
+        struct xproperty_gate
+        {
+            template <class T, class V>
+            static bool unchanged(const T& value, const V& proposal)
+            {
+                return C()(value, proposal);
+            }
+        };
+
+        template <>
+        struct xproperty_gate<void>
+        {
+            template <class T, class V>
+            static constexpr bool unchanged(const T&, const V&) noexcept
+            {
+                return false;
+            }
+        };
+
+        // Proposals are passed to validators as rvalues of the value type of the property:
+        // rvalues of that type are forwarded, other values are converted or copied.
+
+        template <class T, class V>
+        using is_forwardable_proposal = std::integral_constant<bool, std::is_same<std::decay_t<V>, T>::value && !std::is_lvalue_reference<V>::value>;
+
+        template <class T, class V>
+        inline std::enable_if_t<is_forwardable_proposal<T, V>::value, T&&> as_proposal(V&& value) noexcept
+        {
+            return static_cast<T&&>(value);
+        }
+
+        template <class T, class V>
+        inline std::enable_if_t<!is_forwardable_proposal<T, V>::value, T> as_proposal(V&& value)
+        {
+            return T(std::forward<V>(value));
+        }
+
+        // Whether the owner may request the previous value of the property at the
+        // specified offset, see XPROPERTY.
+
+        template <class O, std::size_t Offset, class = void>
+        struct provides_old_value : std::false_type
+        {
+        };
+
+        template <class O, std::size_t Offset>
+        struct provides_old_value<O, Offset, void_t<decltype(std::declval<const O&>().template requires_old_value<Offset>())>>
+            : std::true_type
+        {
+        };
+
+        struct xproperty_access;
+    }
 
     /*************************
      * xproperty declaration *
@@ -49,8 +294,195 @@ namespace xp
 
         owner_type* owner() noexcept;
 
+        template <class P>
+        void assign(P&& proposal, std::false_type);
+
+        template <class P>
+        void assign(P&& proposal, std::true_type);
+
+        // Swaps the values without validation nor notification.
+        void exchange_value(value_type& value);
+
         value_type m_value;
-    }; 
+
+        friend struct detail::xproperty_access;
+    };
+
+    namespace detail
+    {
+        // Value of the property of the owner located at the specified offset.
+
+        template <std::size_t Offset, class O>
+        inline auto get_property(const O& owner) noexcept -> typename xproperty_type<O, xproperty_index_of<O, Offset>::value>::const_reference
+        {
+            using property_type = xproperty_type<O, xproperty_index_of<O, Offset>::value>;
+            return *reinterpret_cast<const property_type*>(reinterpret_cast<const char*>(&owner) + Offset);
+        }
+
+        // Validation, storage and notification steps of an assignment, performed
+        // separately by xp::apply_patch.
+
+        struct xproperty_access
+        {
+            template <class P, class O>
+            static void validate(O& owner, typename P::value_type& proposal)
+            {
+                proposal = owner.template invoke_validators<P::offset(), typename P::value_type>(std::move(proposal));
+            }
+
+            template <class P>
+            static void exchange(P& property, typename P::value_type& value)
+            {
+                property.exchange_value(value);
+            }
+
+            template <class P, class O>
+            static void notify(O& owner, typename P::value_type& old_value)
+            {
+                notify<P>(owner, old_value, provides_old_value<O, P::offset()>());
+            }
+
+            // Marks the property as dirty and journals it without notifying the observers,
+            // for owners tracking their changes. `records` tells whether the owner does.
+
+            template <class O>
+            static bool records(const O& owner) noexcept
+            {
+                return records(owner, 0);
+            }
+
+            template <class P, class O>
+            static void record(const O& owner)
+            {
+                record<P>(owner, 0);
+            }
+
+        private:
+
+            template <class O>
+            static auto records(const O& owner, int) noexcept -> decltype(owner.records_changes())
+            {
+                return owner.records_changes();
+            }
+
+            template <class O>
+            static bool records(const O&, long) noexcept
+            {
+                return false;
+            }
+
+            template <class P, class O>
+            static auto record(const O& owner, int) -> decltype(owner.template record_change<P::offset()>())
+            {
+                owner.template record_change<P::offset()>();
+            }
+
+            template <class P, class O>
+            static void record(const O&, long)
+            {
+            }
+
+            template <class P, class O>
+            static void notify(O& owner, typename P::value_type&, std::false_type)
+            {
+                owner.template invoke_observers<P::offset()>();
+            }
+
+            template <class P, class O>
+            static void notify(O& owner, typename P::value_type& old_value, std::true_type)
+            {
+                if (owner.template requires_old_value<P::offset()>())
+                {
+                    owner.template invoke_observers<P::offset()>(std::move(old_value));
+                }
+                else
+                {
+                    owner.template invoke_observers<P::offset()>();
+                }
+            }
+        };
+
+        // Property of the owner with the specified compile-time index.
+
+        template <std::size_t I, class O>
+        inline xproperty_type<O, I>& property_at(O& owner) noexcept
+        {
+            return *reinterpret_cast<xproperty_type<O, I>*>(reinterpret_cast<char*>(&owner) + xproperty_type<O, I>::offset());
+        }
+
+        template <std::size_t I, class O>
+        inline const xproperty_type<O, I>& property_at(const O& owner) noexcept
+        {
+            return *reinterpret_cast<const xproperty_type<O, I>*>(reinterpret_cast<const char*>(&owner) + xproperty_type<O, I>::offset());
+        }
+
+        template <class O, class F, std::size_t... I>
+        inline void for_each_property_impl(O& owner, F& f, std::index_sequence<I...>)
+        {
+            int dummy[] = { 0, (static_cast<void>(f(property_at<I>(owner))), 0)... };
+            (void)dummy;
+        }
+
+        template <class O, class F, std::size_t I>
+        inline void visit_property_at(O& owner, F& f)
+        {
+            f(property_at<I>(owner));
+        }
+
+        // Calls f with the property of the owner with the specified runtime index.
+        // Returns false when the index is out of range.
+
+        template <class O, class F, std::size_t... I>
+        inline bool visit_property(O& owner, std::size_t index, F& f, std::index_sequence<I...>)
+        {
+            if (index >= sizeof...(I))
+            {
+                return false;
+            }
+            // The leading null pointer keeps the table non-empty for owners without properties.
+            using visitor_type = void (*)(O&, F&);
+            static constexpr visitor_type visitors[] = { nullptr, &visit_property_at<O, F, I>... };
+            visitors[index + 1](owner, f);
+            return true;
+        }
+
+        template <class O, std::size_t... I>
+        constexpr std::array<xproperty_descriptor, sizeof...(I)> make_descriptors(std::index_sequence<I...>) noexcept
+        {
+            return {{ { xproperty_type<O, I>::name(), xproperty_type<O, I>::offset(), I }... }};
+        }
+    }
+
+    /*************************
+     * xproperty descriptors *
+     *************************/
+
+    // xproperty_descriptors<Owner>::value
+    //
+    // Constexpr array describing the properties of the owner, in declaration order.
+
+    template <class O>
+    struct xproperty_descriptors
+    {
+        static constexpr std::array<xproperty_descriptor, xproperty_count<O>::value> value =
+            detail::make_descriptors<O>(std::make_index_sequence<xproperty_count<O>::value>());
+    };
+
+    template <class O>
+    constexpr std::array<xproperty_descriptor, xproperty_count<O>::value> xproperty_descriptors<O>::value;
+
+    // for_each_property(owner, f)
+    //
+    // Calls `f` with each property of the owner, in declaration order. The loop is unrolled
+    // at compile time, and each call receives the property with its own type, which gives
+    // access to its `name()`, `offset()`, `index()` and `value_type`. Assigning a property
+    // from `f` goes through its validators and observers.
+
+    template <class O, class F>
+    inline void for_each_property(O& owner, F&& f)
+    {
+        detail::for_each_property_impl(owner, f, std::make_index_sequence<xproperty_count<std::remove_const_t<O>>::value>());
+    }
 
     /*******************
      * XPROPERTY macro *
@@ -62,20 +494,67 @@ namespace xp
     //
     // The owner type must have two template methods
     //
-    //  - invoke_validators<std::size_t Offset, typename const_ref>( const_ref value);
+    //  - invoke_validators<std::size_t Offset, typename value_type>(value_type&& value);
     //  - invoke_observers<std::size_t Offset>();
     //
+    // It may also have the template methods
+    //
+    //  - requires_old_value<std::size_t Offset>();
+    //  - invoke_observers<std::size_t Offset, typename value_type>(value_type&& old_value);
+    //
+    // in which case the second one is called, with the previous value of the property,
+    // instead of `invoke_observers<Offset>()` when the first one returns true.
+    //
     // Tthe `Offset` integral parameter is the offset of the observed member in the owner class.
-    // The `const_ref` typename is a constant reference type on the proposed value.
+    // The `value_type` typename is the value type of the property: the proposal is always
+    // converted to it, so that lvalue and rvalue proposals resolve to the same validator.
+    //
+    // Each property is also given a dense compile-time index, in declaration order, which
+    // is available through `xproperty_index_of` and `xproperty_type`, and its name is
+    // returned by the static `name()` method. The properties of an owner can be enumerated
+    // with `for_each_property` and `xproperty_descriptors`.
+
+    #define XPROPERTY(T, O, D) XPROPERTY_GENERIC(T, O, D, void)
+
+    // XPROPERTY_GATED(Type, Owner, Name)
+    //
+    // Defines an equality-gated property: assigning a value equal to the current one
+    // returns early, without invoking the validators and the observers.
+
+    #define XPROPERTY_GATED(T, O, D) XPROPERTY_GENERIC(T, O, D, std::equal_to<T>)
+
+    // XPROPERTY_GATED_CMP(Type, Owner, Name, Comparator)
+    //
+    // Defines an equality-gated property using the specified comparator, a default
+    // constructible type whose call operator returns true when the current value
+    // and the proposal are considered equal.
+
+    #define XPROPERTY_GATED_CMP(T, O, D, C) XPROPERTY_GENERIC(T, O, D, C)
+
+    #define XPROPERTY_GENERIC(T, O, D, C) XPROPERTY_DECLARE(::xp::xproperty, T, O, D, C)
 
-    #define XPROPERTY(T, O, D) \
-    class D ## _property  : public ::xp::xproperty<T, O, D ## _property> {\
+    // XPROPERTY_DECLARE(Base, Type, Owner, Name, Comparator)
+    //
+    // Defines a property deriving from the specified class template, instantiated
+    // with the type, the owner type and the generated property type.
+
+    #define XPROPERTY_DECLARE(B, T, O, D, C) \
+    class D ## _property  : public B<T, O, D ## _property> {\
     public:\
+        using comparator_type = C;\
+        using index_constant = decltype(xproperty_index(::xp::detail::index_tag<XPROPERTY_MAX_PROPERTIES>()));\
+        using previous_property = decltype(xproperty_at(::xp::detail::property_slot<index_constant::value - 1>()));\
+        static_assert(index_constant::value < XPROPERTY_MAX_PROPERTIES, "too many properties, increase XPROPERTY_MAX_PROPERTIES");\
         template <class V>\
-        inline typename ::xp::xproperty<T, O, D ## _property>::reference operator=(V&& value)\
-        { return ::xp::xproperty<T, O, D ## _property>::operator=(std::forward<V>(value)); }\
+        inline decltype(auto) operator=(V&& value)\
+        { return B<T, O, D ## _property>::operator=(std::forward<V>(value)); }\
         static inline constexpr std::size_t offset() noexcept { return xoffsetof(O, D); }\
-    } D;
+        static inline constexpr std::size_t index() noexcept { return index_constant::value; }\
+        static inline constexpr const char* name() noexcept { return #D; }\
+    } D;\
+    static D ## _property xproperty_at(::xp::detail::property_slot<D ## _property::index_constant::value>);\
+    static ::xp::detail::index_constant<D ## _property::index_constant::value + 1>\
+    xproperty_index(::xp::detail::index_tag<D ## _property::index_constant::value + 1>)
 
     /***********************
      * MAKE_OBSERVED macro *
@@ -83,13 +562,67 @@ namespace xp
 
     // MAKE_OBSERVED()
     //
-    // Adds the required boilerplate for an obsered structure.
+    // Adds the required boilerplate for an obsered structure. Upon assignment, the static
+    // validators of the property are chained and its static observers are invoked, in
+    // the order of their definitions.
 
     #define MAKE_OBSERVED() \
+    MAKE_HYBRID_OBSERVED() \
     template <std::size_t I> \
-    inline void invoke_observers() const {} \
+    inline void invoke_observers() const \
+    { invoke_static_observers<I>(std::make_index_sequence<XPROPERTY_STATIC_COUNT(xstatic_observer_slots, std::decay_t<decltype(*this)>, I)>()); } \
     template <std::size_t I, class V> \
-    inline auto invoke_validators(V&& r) const { return r; }
+    inline auto invoke_validators(V&& r) const \
+    { return invoke_static_validators<I>(std::forward<V>(r), std::make_index_sequence<XPROPERTY_STATIC_COUNT(xstatic_validator_slots, std::decay_t<decltype(*this)>, I)>()); }
+
+    // MAKE_HYBRID_OBSERVED()
+    //
+    // Adds the boilerplate for the static validators and observers of a structure deriving
+    // from xp::xobserved, which runs them before its dynamic validators and observers.
+
+    #define MAKE_HYBRID_OBSERVED() \
+    template <std::size_t I, std::size_t K> \
+    struct xstatic_observer_slot; \
+    template <std::size_t I, std::size_t K> \
+    struct xstatic_validator_slot; \
+    template <std::size_t I, std::size_t K> \
+    inline void xstatic_observer() const {} \
+    template <std::size_t I, std::size_t K, class V> \
+    inline auto xstatic_validator(V&& r) const { return std::forward<V>(r); } \
+    template <std::size_t I, std::size_t... K> \
+    inline void invoke_static_observers(std::index_sequence<K...>) const \
+    { int dummy[] = { 0, (xstatic_observer<I, K>(), 0)... }; (void)dummy; } \
+    template <std::size_t I, class V, std::size_t... K> \
+    inline auto invoke_static_validators(V&& r, std::index_sequence<K...>) const \
+    { \
+        std::decay_t<V> proposal(std::forward<V>(r)); \
+        int dummy[] = { 0, (proposal = xstatic_validator<I, K, std::decay_t<V>>(std::move(proposal)), 0)... }; \
+        (void)dummy; \
+        return proposal; \
+    }
+
+    // Number of static callbacks of the property at the specified offset of the owner,
+    // once all of them are registered.
+
+    #define XPROPERTY_STATIC_COUNT(S, O, I) \
+    ::xp::detail::xstatic_count<::xp::detail::S<O, I>, void>::value
+
+    // Index of the static callback registered on the current line, that is the number of
+    // callbacks registered before it: the count is instantiated once per line, and keeps
+    // its value after the slot of the callback is specialized.
+
+    #define XPROPERTY_STATIC_INDEX(S, O, D) \
+    ::xp::detail::xstatic_count<::xp::detail::S<O, xoffsetof(O, D)>, ::xp::detail::index_constant<__LINE__>>::value
+
+    // Specializes the slot of the next static observer or validator of the property.
+
+    #define XPROPERTY_STATIC_REGISTER(K, O, D) \
+    static_assert(XPROPERTY_STATIC_INDEX(K ## _slots, O, D) < XPROPERTY_MAX_STATIC_CALLBACKS, \
+                  "too many static callbacks, increase XPROPERTY_MAX_STATIC_CALLBACKS"); \
+    template <> \
+    struct O::K ## _slot<xoffsetof(O, D), XPROPERTY_STATIC_INDEX(K ## _slots, O, D)> \
+    { \
+    }
 
     /*************************
      * XOBSERVE_STATIC macro *
@@ -97,11 +630,13 @@ namespace xp
 
     // XOBSERVE_STATIC(Type, Owner, Name)
     //
-    // Set up the static notifier for the specified property
+    // Set up a static notifier for the specified property. A property can have several
+    // static notifiers, each one starting on its own line.
 
     #define XOBSERVE_STATIC(T, O, D) \
+    XPROPERTY_STATIC_REGISTER(xstatic_observer, O, D); \
     template <> \
-    inline void O::invoke_observers<xoffsetof(O, D)>() const
+    inline void O::xstatic_observer<xoffsetof(O, D), XPROPERTY_STATIC_INDEX(xstatic_observer_slots, O, D)>() const
 
     /**************************
      * XVALIDATE_STATIC macro *
@@ -109,11 +644,15 @@ namespace xp
 
     // XVALIDATE_STATIC(Type, Owner, Name, Proposal Argument Name)
     //
-    // Set up the static validator for the specified property
+    // Set up a static validator for the specified property. The proposal argument is an
+    // rvalue reference: return `std::move(A)` to avoid copying large values. A property
+    // can have several static validators, each one starting on its own line and receiving
+    // the result of the previous one.
 
     #define XVALIDATE_STATIC(T, O, D, A) \
+    XPROPERTY_STATIC_REGISTER(xstatic_validator, O, D); \
     template <> \
-    inline auto O::invoke_validators<xoffsetof(O, D), T>(T&& A) const
+    inline auto O::xstatic_validator<xoffsetof(O, D), XPROPERTY_STATIC_INDEX(xstatic_validator_slots, O, D), T>(T&& A) const
 
     /****************************
      * xproperty implementation *
@@ -127,7 +666,7 @@ namespace xp
     
     template <class T, class O, class D>
     inline xproperty<T, O, D>::xproperty(value_type&& value) noexcept(noexcept(std::is_nothrow_move_constructible<value_type>::value))
-        : m_value(value)
+        : m_value(std::move(value))
     {
     }
     
@@ -153,8 +692,12 @@ namespace xp
     template <class V>
     inline auto xproperty<T, O, D>::operator=(V&& value) -> reference
     {
-        m_value = owner()->template invoke_validators<derived_type::offset()>(std::forward<V>(value));
-        owner()->template invoke_observers<derived_type::offset()>();
+        if (detail::xproperty_gate<typename derived_type::comparator_type>::unchanged(m_value, value))
+        {
+            return m_value;
+        }
+        assign(owner()->template invoke_validators<derived_type::offset(), value_type>(detail::as_proposal<value_type>(std::forward<V>(value))),
+               detail::provides_old_value<owner_type, derived_type::offset()>());
         return m_value;
     }
 
@@ -163,6 +706,41 @@ namespace xp
     {
         return reinterpret_cast<owner_type*>(reinterpret_cast<char*>(this) - derived_type::offset());
     }
+
+    template <class T, class O, class D>
+    template <class P>
+    inline void xproperty<T, O, D>::assign(P&& proposal, std::false_type)
+    {
+        m_value = std::forward<P>(proposal);
+        owner()->template invoke_observers<derived_type::offset()>();
+    }
+
+    // The previous value is only kept when an observer asks for it.
+
+    template <class T, class O, class D>
+    template <class P>
+    inline void xproperty<T, O, D>::assign(P&& proposal, std::true_type)
+    {
+        owner_type* o = owner();
+        if (o->template requires_old_value<derived_type::offset()>())
+        {
+            value_type old_value(std::move(m_value));
+            m_value = std::forward<P>(proposal);
+            o->template invoke_observers<derived_type::offset()>(std::move(old_value));
+        }
+        else
+        {
+            m_value = std::forward<P>(proposal);
+            o->template invoke_observers<derived_type::offset()>();
+        }
+    }
+
+    template <class T, class O, class D>
+    inline void xproperty<T, O, D>::exchange_value(value_type& value)
+    {
+        using std::swap;
+        swap(m_value, value);
+    }
 }
 
 #endif
@@ -12,4 +12,31 @@
 #define XPROPERTY_VERSION_MAJOR 0
 #define XPROPERTY_VERSION_MINOR 1
 #define XPROPERTY_VERSION_PATCH dev0
+
+// Maximum number of properties declared with XPROPERTY in a single owner.
+#ifndef XPROPERTY_MAX_PROPERTIES
+#define XPROPERTY_MAX_PROPERTIES 64
+#endif
+
+// Maximum number of static observers, and of static validators, of a single property.
+#ifndef XPROPERTY_MAX_STATIC_CALLBACKS
+#define XPROPERTY_MAX_STATIC_CALLBACKS 16
+#endif
+
+// Size in bytes of the inline buffer of the callbacks stored by xobserved.
+#ifndef XPROPERTY_CALLBACK_CAPACITY
+#define XPROPERTY_CALLBACK_CAPACITY (4 * sizeof(void*))
+#endif
+
+// Number of observers of an xobserved object stored in its side table before the
+// next ones are allocated on the heap.
+#ifndef XPROPERTY_INLINE_OBSERVERS
+#define XPROPERTY_INLINE_OBSERVERS 4
+#endif
+
+// Maximum size in bytes of the values recorded by xjournal.
+#ifndef XPROPERTY_JOURNAL_VALUE_SIZE
+#define XPROPERTY_JOURNAL_VALUE_SIZE 16
+#endif
+
 #endif
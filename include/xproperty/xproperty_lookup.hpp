@@ -0,0 +1,337 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XPROPERTY_LOOKUP_HPP
+#define XPROPERTY_LOOKUP_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "xproperty.hpp"
+
+namespace xp
+{
+
+    /******************
+     * xproperty_name *
+     ******************/
+
+    // Non-owning view on the name of a property.
+
+    class xproperty_name
+    {
+    public:
+
+        xproperty_name(const char* name) noexcept;
+        xproperty_name(const std::string& name) noexcept;
+        xproperty_name(const char* data, std::size_t size) noexcept;
+
+        const char* data() const noexcept;
+        std::size_t size() const noexcept;
+
+    private:
+
+        const char* p_data;
+        std::size_t m_size;
+    };
+
+    namespace detail
+    {
+        // 64-bit FNV-1a hash of a name.
+
+        constexpr std::uint64_t name_hash(const char* data, std::size_t size) noexcept
+        {
+            std::uint64_t h = 14695981039346656037ull;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                h = (h ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+            }
+            return h;
+        }
+
+        constexpr std::size_t name_length(const char* name) noexcept
+        {
+            std::size_t size = 0;
+            while (name[size] != '\0')
+            {
+                ++size;
+            }
+            return size;
+        }
+
+        // Rehashes the hash of a name with the seed of its bucket.
+
+        constexpr std::uint64_t name_mix(std::uint64_t h, std::uint64_t seed) noexcept
+        {
+            h ^= (seed + 1) * 0x9E3779B97F4A7C15ull;
+            h ^= h >> 32;
+            h *= 0xD6E8FEB86659FD93ull;
+            h ^= h >> 32;
+            return h;
+        }
+
+        constexpr std::size_t ceil_power_of_two(std::size_t n) noexcept
+        {
+            std::size_t res = 1;
+            while (res < n)
+            {
+                res <<= 1;
+            }
+            return res;
+        }
+
+        // Perfect hash table over the names of N properties, built with the hash and
+        // displace method: the names are distributed in buckets by their hash, then
+        // the buckets are placed by decreasing size, each one with the first seed
+        // sending all its names to free slots. A lookup hashes the name once, and
+        // compares it with the single candidate of its slot.
+
+        template <std::size_t N>
+        struct xname_table
+        {
+            static constexpr std::size_t bucket_count = ceil_power_of_two(N);
+            static constexpr std::size_t slot_count = ceil_power_of_two(2 * N);
+            static constexpr std::uint32_t max_seed = 1u << 16;
+
+            std::uint32_t seeds[bucket_count];
+            // Index of the property plus one, zero for empty slots.
+            std::size_t slots[slot_count];
+            std::size_t sizes[slot_count];
+            bool valid;
+        };
+
+        template <std::size_t N>
+        constexpr xname_table<N> make_name_table(const std::array<xproperty_descriptor, N>& descriptors) noexcept
+        {
+            using table_type = xname_table<N>;
+            constexpr std::size_t bucket_mask = table_type::bucket_count - 1;
+            constexpr std::size_t slot_mask = table_type::slot_count - 1;
+
+            table_type table = {};
+            table.valid = true;
+
+            std::uint64_t hashes[N + 1] = {};
+            std::size_t sizes[N + 1] = {};
+            std::size_t bucket_sizes[table_type::bucket_count] = {};
+            for (std::size_t i = 0; i < N; ++i)
+            {
+                sizes[i] = name_length(descriptors[i].name);
+                hashes[i] = name_hash(descriptors[i].name, sizes[i]);
+                ++bucket_sizes[hashes[i] & bucket_mask];
+            }
+
+            for (std::size_t bucket_size = N; bucket_size != 0; --bucket_size)
+            {
+                for (std::size_t b = 0; b < table_type::bucket_count; ++b)
+                {
+                    if (bucket_sizes[b] != bucket_size)
+                    {
+                        continue;
+                    }
+                    std::uint32_t seed = 0;
+                    bool placed = false;
+                    while (!placed && seed != table_type::max_seed)
+                    {
+                        std::size_t candidates[N + 1] = {};
+                        std::size_t count = 0;
+                        placed = true;
+                        for (std::size_t i = 0; i < N && placed; ++i)
+                        {
+                            if ((hashes[i] & bucket_mask) != b)
+                            {
+                                continue;
+                            }
+                            std::size_t slot = name_mix(hashes[i], seed) & slot_mask;
+                            placed = table.slots[slot] == 0;
+                            for (std::size_t j = 0; j < count && placed; ++j)
+                            {
+                                placed = candidates[j] != slot;
+                            }
+                            candidates[count++] = slot;
+                        }
+                        if (placed)
+                        {
+                            std::size_t j = 0;
+                            for (std::size_t i = 0; i < N; ++i)
+                            {
+                                if ((hashes[i] & bucket_mask) == b)
+                                {
+                                    table.slots[candidates[j]] = i + 1;
+                                    table.sizes[candidates[j]] = sizes[i];
+                                    ++j;
+                                }
+                            }
+                            table.seeds[b] = seed;
+                        }
+                        else
+                        {
+                            ++seed;
+                        }
+                    }
+                    table.valid = table.valid && placed;
+                }
+            }
+            return table;
+        }
+
+        template <class O>
+        struct xname_lookup
+        {
+            using table_type = xname_table<xproperty_count<O>::value>;
+
+            static constexpr table_type table = make_name_table(xproperty_descriptors<O>::value);
+            static_assert(table.valid, "cannot build a perfect hash table over the property names");
+        };
+
+        template <class O>
+        constexpr typename xname_lookup<O>::table_type xname_lookup<O>::table;
+
+        template <class P, class V>
+        inline void write_property(P& property, V&& value, std::true_type)
+        {
+            property = std::forward<V>(value);
+        }
+
+        template <class P, class V>
+        inline void write_property(P&, V&&, std::false_type)
+        {
+            throw std::invalid_argument(std::string("cannot assign the value to the property ") + P::name());
+        }
+
+        template <class P, class T>
+        inline void read_property(const P& property, T& value, std::true_type)
+        {
+            value = static_cast<typename P::const_reference>(property);
+        }
+
+        template <class P, class T>
+        inline void read_property(const P&, T&, std::false_type)
+        {
+            throw std::invalid_argument(std::string("cannot convert the property ") + P::name());
+        }
+    }
+
+    // xproperty_index_of_name<Owner>(name)
+    //
+    // Compile-time index of the property of the owner with the specified name, or
+    // `xproperty_count<Owner>::value` when there is no such property.
+
+    template <class O>
+    std::size_t xproperty_index_of_name(xproperty_name name) noexcept;
+
+    // visit_by_name(owner, name, f)
+    //
+    // Calls `f` with the property of the owner with the specified name, see
+    // `for_each_property`. Returns false when there is no such property.
+
+    template <class O, class F>
+    bool visit_by_name(O& owner, xproperty_name name, F&& f);
+
+    // set_by_name(owner, name, value)
+    //
+    // Assigns the value to the property of the owner with the specified name, through
+    // its validators and observers. Returns false when there is no such property, and
+    // throws std::invalid_argument when the value cannot be converted to its type.
+
+    template <class O, class V>
+    bool set_by_name(O& owner, xproperty_name name, V&& value);
+
+    // get_by_name(owner, name, value)
+    //
+    // Assigns the value of the property of the owner with the specified name to `value`.
+    // Returns false when there is no such property, and throws std::invalid_argument when
+    // the value of the property cannot be converted to the type of `value`.
+
+    template <class O, class T>
+    bool get_by_name(const O& owner, xproperty_name name, T& value);
+
+    /*********************************
+     * xproperty_name implementation *
+     *********************************/
+
+    inline xproperty_name::xproperty_name(const char* name) noexcept
+        : p_data(name), m_size(std::strlen(name))
+    {
+    }
+
+    inline xproperty_name::xproperty_name(const std::string& name) noexcept
+        : p_data(name.data()), m_size(name.size())
+    {
+    }
+
+    inline xproperty_name::xproperty_name(const char* data, std::size_t size) noexcept
+        : p_data(data), m_size(size)
+    {
+    }
+
+    inline const char* xproperty_name::data() const noexcept
+    {
+        return p_data;
+    }
+
+    inline std::size_t xproperty_name::size() const noexcept
+    {
+        return m_size;
+    }
+
+    /*********************************
+     * lookup by name implementation *
+     *********************************/
+
+    template <class O>
+    inline std::size_t xproperty_index_of_name(xproperty_name name) noexcept
+    {
+        using lookup_type = detail::xname_lookup<O>;
+        using table_type = typename lookup_type::table_type;
+        constexpr const table_type& table = lookup_type::table;
+
+        std::uint64_t h = detail::name_hash(name.data(), name.size());
+        std::size_t slot = detail::name_mix(h, table.seeds[h & (table_type::bucket_count - 1)]) & (table_type::slot_count - 1);
+        std::size_t index = table.slots[slot];
+        if (index != 0 && table.sizes[slot] == name.size() &&
+            std::memcmp(xproperty_descriptors<O>::value[index - 1].name, name.data(), name.size()) == 0)
+        {
+            return index - 1;
+        }
+        return xproperty_count<O>::value;
+    }
+
+    template <class O, class F>
+    inline bool visit_by_name(O& owner, xproperty_name name, F&& f)
+    {
+        using owner_type = std::remove_const_t<O>;
+        std::size_t index = xproperty_index_of_name<owner_type>(name);
+        return detail::visit_property(owner, index, f, std::make_index_sequence<xproperty_count<owner_type>::value>());
+    }
+
+    template <class O, class V>
+    inline bool set_by_name(O& owner, xproperty_name name, V&& value)
+    {
+        return visit_by_name(owner, name, [&value](auto& property) {
+            using value_type = typename std::decay_t<decltype(property)>::value_type;
+            detail::write_property(property, std::forward<V>(value), std::is_constructible<value_type, V&&>());
+        });
+    }
+
+    template <class O, class T>
+    inline bool get_by_name(const O& owner, xproperty_name name, T& value)
+    {
+        return visit_by_name(owner, name, [&value](const auto& property) {
+            using const_reference = typename std::decay_t<decltype(property)>::const_reference;
+            detail::read_property(property, value, std::is_assignable<T&, const_reference>());
+        });
+    }
+}
+
+#endif
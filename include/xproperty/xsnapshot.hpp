@@ -0,0 +1,304 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#ifndef XSNAPSHOT_HPP
+#define XSNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "xobserved.hpp"
+#include "xpatch.hpp"
+#include "xproperty.hpp"
+
+namespace xp
+{
+    namespace detail
+    {
+        // Whether the properties of an owner are trivially copyable and laid out without
+        // gaps, so that they can be captured and restored with a single memcpy.
+
+        template <class O, std::size_t... I>
+        constexpr bool is_memcpy_snapshot_impl(std::index_sequence<I...>) noexcept
+        {
+            constexpr bool trivial[] = { true, std::is_trivially_copyable<xproperty_type<O, I>>::value... };
+            constexpr std::size_t offsets[] = { 0, xproperty_type<O, I>::offset()... };
+            constexpr std::size_t sizes[] = { 0, sizeof(xproperty_type<O, I>)... };
+            for (std::size_t i = 1; i <= sizeof...(I); ++i)
+            {
+                if (!trivial[i] || (i > 1 && offsets[i] != offsets[i - 1] + sizes[i - 1]))
+                {
+                    return false;
+                }
+            }
+            return sizeof...(I) != 0;
+        }
+
+        template <class O>
+        struct is_memcpy_snapshot
+            : std::integral_constant<bool, is_memcpy_snapshot_impl<O>(std::make_index_sequence<xproperty_count<O>::value>())>
+        {
+        };
+
+        template <class O, bool = is_memcpy_snapshot<O>::value>
+        class xsnapshot_storage;
+    }
+
+    /*************************
+     * xsnapshot declaration *
+     *************************/
+
+    // Copy of the values of the properties of an owner, without its callbacks. When the
+    // properties are trivially copyable and contiguous, capturing and restoring a
+    // snapshot without notification is a single memcpy.
+
+    template <class O>
+    class xsnapshot
+    {
+    public:
+
+        using owner_type = O;
+
+        explicit xsnapshot(const O& owner);
+
+        // Captures the current values of the owner, reusing the snapshot.
+        void capture(const O& owner);
+
+        // Assigns the values of the snapshot to the owner, without running the validators.
+        // With notifications, the observers of each property are invoked once all the
+        // values are restored, except for equality-gated properties whose value does
+        // not change. Without notifications, the restored properties are still marked
+        // as dirty and journaled.
+        void restore(O& owner, bool notify = true) const;
+
+    private:
+
+        detail::xsnapshot_storage<O> m_storage;
+    };
+
+    // snapshot(owner)
+    //
+    // Returns a snapshot of the values of the properties of the owner.
+
+    template <class O>
+    xsnapshot<O> snapshot(const O& owner);
+
+    // restore(owner, snapshot, notify = true)
+    //
+    // Restores the values of the snapshot, see xsnapshot::restore.
+
+    template <class O>
+    void restore(O& owner, const xsnapshot<O>& snapshot, bool notify = true);
+
+    /****************************
+     * xsnapshot implementation *
+     ****************************/
+
+    namespace detail
+    {
+        // Notifies the observers of the properties whose value differs from the previous
+        // one, or that are not equality-gated.
+
+        template <class O, class P>
+        inline void notify_restored(O& owner, const P& property, typename P::value_type& old_value)
+        {
+            if (!xproperty_gate<typename P::comparator_type>::unchanged(old_value, static_cast<typename P::const_reference>(property)))
+            {
+                xproperty_access::notify<P>(owner, old_value);
+            }
+        }
+
+        // Bytes of the contiguous properties of the owner.
+
+        template <class O>
+        class xsnapshot_storage<O, true>
+        {
+        public:
+
+            void capture(const O& owner) noexcept
+            {
+                std::memcpy(m_data, reinterpret_cast<const char*>(&owner) + first, size);
+            }
+
+            void restore(O& owner, bool notify) const
+            {
+                if (!notify)
+                {
+                    if (!xproperty_access::records(owner))
+                    {
+                        std::memcpy(reinterpret_cast<char*>(&owner) + first, m_data, size);
+                        return;
+                    }
+                    xbitmask<xproperty_count<O>::value> changed;
+                    compare(owner, changed, std::make_index_sequence<xproperty_count<O>::value>());
+                    std::memcpy(reinterpret_cast<char*>(&owner) + first, m_data, size);
+                    record(owner, changed, std::make_index_sequence<xproperty_count<O>::value>());
+                    return;
+                }
+                xsnapshot_storage previous;
+                previous.capture(owner);
+                std::memcpy(reinterpret_cast<char*>(&owner) + first, m_data, size);
+                previous.notify(owner, std::make_index_sequence<xproperty_count<O>::value>());
+            }
+
+        private:
+
+            static constexpr std::size_t first = xproperty_type<O, 0>::offset();
+            static constexpr std::size_t size = xproperty_type<O, xproperty_count<O>::value - 1>::offset()
+                                                + sizeof(xproperty_type<O, xproperty_count<O>::value - 1>) - first;
+
+            // Properties whose bytes differ from those of the snapshot.
+            template <class B, std::size_t... I>
+            void compare(const O& owner, B& changed, std::index_sequence<I...>) const noexcept
+            {
+                auto test = [this, &owner, &changed](auto index) {
+                    constexpr std::size_t i = decltype(index)::value;
+                    using property_type = xproperty_type<O, i>;
+                    if (std::memcmp(&property_at<i>(owner), m_data + property_type::offset() - first, sizeof(property_type)) != 0)
+                    {
+                        changed.set(i);
+                    }
+                    return 0;
+                };
+                int dummy[] = { 0, test(index_constant<I>())... };
+                (void)dummy;
+            }
+
+            template <class B, std::size_t... I>
+            static void record(const O& owner, const B& changed, std::index_sequence<I...>)
+            {
+                auto invoke = [&owner, &changed](auto index) {
+                    constexpr std::size_t i = decltype(index)::value;
+                    if (changed.test(i))
+                    {
+                        xproperty_access::record<xproperty_type<O, i>>(owner);
+                    }
+                    return 0;
+                };
+                int dummy[] = { 0, invoke(index_constant<I>())... };
+                (void)dummy;
+            }
+
+            template <std::size_t... I>
+            void notify(O& owner, std::index_sequence<I...>) const
+            {
+                auto invoke = [this, &owner](auto index) {
+                    constexpr std::size_t i = decltype(index)::value;
+                    using property_type = xproperty_type<O, i>;
+                    property_type previous;
+                    std::memcpy(&previous, m_data + property_type::offset() - first, sizeof(property_type));
+                    typename property_type::value_type old_value = static_cast<typename property_type::const_reference>(previous);
+                    notify_restored(owner, property_at<i>(static_cast<const O&>(owner)), old_value);
+                    return 0;
+                };
+                int dummy[] = { 0, invoke(index_constant<I>())... };
+                (void)dummy;
+            }
+
+            alignas(O) char m_data[size];
+        };
+
+        // Copies of the values of the properties of the owner.
+
+        template <class O>
+        class xsnapshot_storage<O, false>
+        {
+        public:
+
+            void capture(const O& owner)
+            {
+                capture(owner, std::make_index_sequence<xproperty_count<O>::value>());
+            }
+
+            void restore(O& owner, bool notify) const
+            {
+                restore(owner, notify, std::make_index_sequence<xproperty_count<O>::value>());
+            }
+
+        private:
+
+            template <class S>
+            struct values;
+
+            template <std::size_t... I>
+            struct values<std::index_sequence<I...>>
+            {
+                using type = std::tuple<typename xproperty_type<O, I>::value_type...>;
+            };
+
+            using values_type = typename values<std::make_index_sequence<xproperty_count<O>::value>>::type;
+
+            template <std::size_t... I>
+            void capture(const O& owner, std::index_sequence<I...>)
+            {
+                int dummy[] = { 0, (std::get<I>(m_values) = static_cast<typename xproperty_type<O, I>::const_reference>(property_at<I>(owner)), 0)... };
+                (void)dummy;
+            }
+
+            // The values are restored like an xpatch, without validation, and with the
+            // gated properties whose value does not change left out.
+            template <std::size_t... I>
+            void restore(O& owner, bool notify, std::index_sequence<I...> seq) const
+            {
+                typename xpatch_values<O, std::index_sequence<I...>>::type restored;
+                xbitmask<xproperty_count<O>::value> changed;
+                auto copy = [this, &owner, &restored, &changed](auto index) {
+                    constexpr std::size_t i = decltype(index)::value;
+                    using property_type = xproperty_type<O, i>;
+                    const auto& value = std::get<i>(m_values);
+                    if (!xproperty_gate<typename property_type::comparator_type>::unchanged(static_cast<typename property_type::const_reference>(property_at<i>(static_cast<const O&>(owner))), value))
+                    {
+                        std::get<i>(restored).emplace(typename property_type::value_type(value));
+                        changed.set(i);
+                    }
+                    return 0;
+                };
+                int dummy[] = { 0, copy(index_constant<I>())... };
+                (void)dummy;
+                commit_patch(owner, restored, changed, notify, seq);
+            }
+
+            values_type m_values;
+        };
+    }
+
+    template <class O>
+    inline xsnapshot<O>::xsnapshot(const O& owner)
+    {
+        m_storage.capture(owner);
+    }
+
+    template <class O>
+    inline void xsnapshot<O>::capture(const O& owner)
+    {
+        m_storage.capture(owner);
+    }
+
+    template <class O>
+    inline void xsnapshot<O>::restore(O& owner, bool notify) const
+    {
+        m_storage.restore(owner, notify);
+    }
+
+    template <class O>
+    inline xsnapshot<O> snapshot(const O& owner)
+    {
+        return xsnapshot<O>(owner);
+    }
+
+    template <class O>
+    inline void restore(O& owner, const xsnapshot<O>& snapshot, bool notify)
+    {
+        snapshot.restore(owner, notify);
+    }
+}
+
+#endif
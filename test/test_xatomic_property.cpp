@@ -0,0 +1,163 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "xproperty/xatomic_property.hpp"
+#include "xproperty/xobserved.hpp"
+#include "xproperty/xobserved_mt.hpp"
+
+namespace
+{
+
+struct Counter : public xp::xobserved<Counter>
+{
+    XPROPERTY_ATOMIC(int, Counter, count);
+    XPROPERTY_ATOMIC(bool, Counter, flag);
+};
+
+struct SharedCounter : public xp::xobserved_mt<SharedCounter>
+{
+    XPROPERTY_ATOMIC(int, SharedCounter, count);
+};
+
+struct StaticCounter
+{
+    MAKE_OBSERVED()
+
+    XPROPERTY_ATOMIC(int, StaticCounter, count);
+
+    mutable int observed = 0;
+};
+
+XOBSERVE_STATIC(int, StaticCounter, count)
+{
+    ++observed;
+}
+
+}
+
+TEST(xatomic_property, basic)
+{
+    Counter counter;
+    int observed = 0;
+    int old_value = -1, new_value = -1;
+    XOBSERVE(counter, count, [&observed](const Counter&) { ++observed; });
+    XVALIDATE(counter, count, [](const Counter&, int proposal) { return proposal < 0 ? 0 : proposal; });
+
+    counter.count = 3;
+    ASSERT_EQ(3, counter.count.load());
+    ASSERT_EQ(1, observed);
+
+    counter.count.store(-1);
+    ASSERT_EQ(0, int(counter.count));
+    ASSERT_EQ(2, observed);
+
+    XOBSERVE(counter, count, [&](const Counter&, const xp::change<int>& c) { old_value = c.old_value; new_value = c.new_value; });
+    ASSERT_EQ(0, counter.count.fetch_add(5));
+    ASSERT_EQ(0, old_value);
+    ASSERT_EQ(5, new_value);
+    ASSERT_EQ(3, observed);
+
+    int expected = 4;
+    ASSERT_FALSE(counter.count.compare_exchange_strong(expected, 10));
+    ASSERT_EQ(5, expected);
+    ASSERT_EQ(3, observed);
+    ASSERT_TRUE(counter.count.compare_exchange_strong(expected, 10));
+    ASSERT_EQ(5, old_value);
+    ASSERT_EQ(10, new_value);
+    ASSERT_EQ(4, observed);
+
+    Counter copy = counter;
+    ASSERT_EQ(10, copy.count.load());
+}
+
+TEST(xatomic_property, concurrent_fetch_add)
+{
+    Counter counter;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&counter]() {
+            for (int j = 0; j < 10000; ++j)
+            {
+                counter.count.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    ASSERT_EQ(40000, counter.count.load());
+}
+
+TEST(xatomic_property, concurrent_observers)
+{
+    Counter counter;
+    std::atomic<int> observed(0);
+    std::atomic<int> mismatches(0);
+    std::atomic<int> sum(0);
+    XOBSERVE(counter, count, [&](const Counter&) { observed.fetch_add(1, std::memory_order_relaxed); });
+    // The change holds the value stored by the notifying thread.
+    XOBSERVE(counter, count, [&](const Counter&, const xp::change<int>& c) {
+        if (c.new_value != c.old_value + 1)
+        {
+            mismatches.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    XOBSERVE(counter, flag, [&](const Counter&, const xp::change<bool>& c) { sum.fetch_add(c.new_value ? 1 : -1, std::memory_order_relaxed); });
+    counter.track_dirty();
+    // Atomic properties ignore holds.
+    auto hold = xp::hold_notifications(counter);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&counter, i]() {
+            for (int j = 0; j < 10000; ++j)
+            {
+                counter.count.fetch_add(1, std::memory_order_relaxed);
+            }
+            counter.flag = (i % 2 == 0);
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    ASSERT_EQ(40000, counter.count.load());
+    ASSERT_EQ(40000, observed.load());
+    ASSERT_EQ(0, mismatches.load());
+    ASSERT_EQ(0, sum.load());
+    ASSERT_TRUE(counter.dirty<xoffsetof(Counter, count)>());
+    ASSERT_TRUE(counter.dirty<xoffsetof(Counter, flag)>());
+}
+
+TEST(xatomic_property, owners)
+{
+    SharedCounter shared;
+    int old_value = -1, new_value = -1;
+    XOBSERVE(shared, count, [&](const SharedCounter&, const xp::change<int>& c) { old_value = c.old_value; new_value = c.new_value; });
+    shared.count.fetch_add(2);
+    ASSERT_EQ(0, old_value);
+    ASSERT_EQ(2, new_value);
+    shared.count.store(5);
+    ASSERT_EQ(2, old_value);
+    ASSERT_EQ(5, new_value);
+
+    StaticCounter counter;
+    counter.count = 1;
+    counter.count.fetch_sub(3);
+    ASSERT_EQ(-2, counter.count.load());
+    ASSERT_EQ(2, counter.observed);
+}
@@ -0,0 +1,87 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include "xproperty/xcoroutine.hpp"
+
+#if XPROPERTY_HAS_COROUTINES
+
+#include <exception>
+#include <vector>
+
+namespace
+{
+
+struct Foo : public xp::xobserved<Foo>
+{
+    XPROPERTY(double, Foo, bar);
+    XPROPERTY(double, Foo, baz);
+};
+
+// Eagerly started coroutine, destroyed with its frame when it completes
+
+struct task
+{
+    struct promise_type
+    {
+        task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+task collect(Foo& foo, std::vector<double>& values, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        values.push_back(co_await xp::changed(foo, &Foo::bar));
+    }
+}
+
+}
+
+TEST(xcoroutine, changed)
+{
+    Foo foo;
+    std::vector<double> values;
+    collect(foo, values, 2);
+    ASSERT_TRUE(values.empty());
+
+    foo.baz = 1.0;
+    ASSERT_TRUE(values.empty());
+
+    foo.bar = 2.0;
+    ASSERT_EQ(std::vector<double>({ 2.0 }), values);
+
+    foo.bar = 3.0;
+    ASSERT_EQ(std::vector<double>({ 2.0, 3.0 }), values);
+
+    foo.bar = 4.0;
+    ASSERT_EQ(2u, values.size());
+}
+
+TEST(xcoroutine, resumed_after_observers)
+{
+    Foo foo;
+    std::vector<double> values;
+    collect(foo, values, 1);
+    XOBSERVE(foo, bar, [&](const Foo& f) { values.push_back(-f.bar); });
+
+    // The coroutine completes and destroys its frame, holding the first observer,
+    // once the observers have been invoked.
+    foo.bar = 2.0;
+    ASSERT_EQ(std::vector<double>({ -2.0, 2.0 }), values);
+
+    foo.bar = 3.0;
+    ASSERT_EQ(std::vector<double>({ -2.0, 2.0, -3.0 }), values);
+}
+
+#endif
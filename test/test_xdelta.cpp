@@ -0,0 +1,161 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "xproperty/xatomic_property.hpp"
+#include "xproperty/xdelta.hpp"
+#include "xproperty/xobserved.hpp"
+
+namespace
+{
+
+struct point
+{
+    double x;
+    double y;
+};
+
+struct Shape : public xp::xobserved<Shape>
+{
+    XPROPERTY(point, Shape, origin);
+    XPROPERTY(std::string, Shape, label);
+    XPROPERTY(int, Shape, width);
+    XPROPERTY_ATOMIC(int, Shape, count);
+};
+
+// Value whose encoding does not fit in a delta record
+
+struct blob
+{
+    std::string data;
+};
+
+struct Storage : public xp::xobserved<Storage>
+{
+    XPROPERTY(int, Storage, id);
+    XPROPERTY(blob, Storage, content);
+};
+
+}
+
+namespace xp
+{
+    template <>
+    struct xdelta_codec<blob>
+    {
+        static std::size_t size(const blob&) noexcept
+        {
+            return std::size_t(std::numeric_limits<std::uint32_t>::max()) + 1;
+        }
+
+        static void write(const blob&, char*) noexcept
+        {
+        }
+
+        static blob read(const char*, std::size_t)
+        {
+            return blob();
+        }
+    };
+}
+
+TEST(xdelta, round_trip)
+{
+    Shape source;
+    source.origin = point{ 1.0, 2.0 };
+    source.label = "a label";
+    source.width = 3;
+    source.count = 4;
+
+    std::vector<char> buffer;
+    xp::encode_properties(source, buffer);
+
+    Shape target;
+    int observed = 0;
+    XOBSERVE(target, label, [&observed](const Shape&) { ++observed; });
+    ASSERT_EQ(buffer.size(), xp::decode_delta(target, buffer.data(), buffer.size()));
+    ASSERT_EQ(2.0, static_cast<const point&>(target.origin).y);
+    ASSERT_EQ(std::string("a label"), static_cast<const std::string&>(target.label));
+    ASSERT_EQ(3, target.width);
+    ASSERT_EQ(4, target.count.load());
+    ASSERT_EQ(1, observed);
+}
+
+TEST(xdelta, dirty_only)
+{
+    Shape source;
+    source.track_dirty();
+    source.width = 3;
+    source.label = "a label";
+
+    std::vector<char> buffer;
+    xp::encode_delta(source, buffer);
+    source.clear_dirty();
+    xp::encode_delta(source, buffer);
+    ASSERT_EQ(4u + 2 * (2u + 4u) + sizeof(int) + 7u + 4u, buffer.size());
+
+    Shape target;
+    XVALIDATE(target, width, [](const Shape&, int proposal) { return proposal * 2; });
+    std::size_t consumed = xp::decode_delta(target, buffer.data(), buffer.size());
+    ASSERT_EQ(6, target.width);
+    ASSERT_EQ(std::string("a label"), static_cast<const std::string&>(target.label));
+    ASSERT_EQ(4u, xp::decode_delta(target, buffer.data() + consumed, buffer.size() - consumed));
+}
+
+TEST(xdelta, malformed)
+{
+    Shape source;
+    std::vector<char> buffer;
+    xp::encode_properties(source, buffer);
+
+    Shape target;
+    ASSERT_THROW(xp::decode_delta(target, buffer.data(), buffer.size() - 1), std::invalid_argument);
+    ASSERT_THROW(xp::decode_delta(target, buffer.data(), 2), std::invalid_argument);
+
+    // Invalid property index of the first entry
+    buffer[4] = 10;
+    ASSERT_THROW(xp::decode_delta(target, buffer.data(), buffer.size()), std::invalid_argument);
+
+    // A bad entry after a valid one leaves the target unchanged
+    source.width = 3;
+    std::vector<char> record;
+    xp::encode_properties(source, record);
+    const std::size_t second = 4 + 6 + sizeof(point);
+    int observed = 0;
+    XOBSERVE(target, origin, [&observed](const Shape&) { ++observed; });
+    std::vector<char> corrupted = record;
+    corrupted[second] = 10;
+    ASSERT_THROW(xp::decode_delta(target, corrupted.data(), corrupted.size()), std::invalid_argument);
+    ASSERT_EQ(0, observed);
+
+    // Truncated last entry
+    corrupted = record;
+    corrupted[0] = static_cast<char>(corrupted[0] - 1);
+    ASSERT_THROW(xp::decode_delta(target, corrupted.data(), corrupted.size()), std::invalid_argument);
+    ASSERT_EQ(0, observed);
+    ASSERT_EQ(0, target.width);
+}
+
+TEST(xdelta, oversized)
+{
+    if (sizeof(std::size_t) <= sizeof(std::uint32_t))
+    {
+        return;
+    }
+    Storage source;
+    std::vector<char> buffer = { 'a', 'b' };
+    ASSERT_THROW(xp::encode_properties(source, buffer), std::length_error);
+    ASSERT_EQ(std::vector<char>({ 'a', 'b' }), buffer);
+}
@@ -0,0 +1,117 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "xproperty/xexecutor.hpp"
+#include "xproperty/xobserved.hpp"
+
+namespace
+{
+
+struct node : xp::xmpsc_node
+{
+    explicit node(int v) : value(v) {}
+    int value;
+};
+
+struct Foo : public xp::xobserved<Foo>
+{
+    XPROPERTY(int, Foo, bar);
+    XPROPERTY(int, Foo, baz);
+};
+
+}
+
+TEST(xexecutor, mpsc_queue)
+{
+    xp::xmpsc_queue queue;
+    ASSERT_EQ(nullptr, queue.pop());
+    node n0(0), n1(1), n2(2);
+    queue.push(&n0);
+    queue.push(&n1);
+    ASSERT_EQ(0, static_cast<node*>(queue.pop())->value);
+    queue.push(&n2);
+    ASSERT_EQ(1, static_cast<node*>(queue.pop())->value);
+    ASSERT_EQ(2, static_cast<node*>(queue.pop())->value);
+    ASSERT_EQ(nullptr, queue.pop());
+}
+
+TEST(xexecutor, worker_pool_ordering)
+{
+    std::vector<int> first, second;
+    std::atomic<int> count(0);
+    {
+        xp::xworker_pool pool(4);
+        std::thread producer([&]() {
+            for (int i = 0; i < 1000; ++i)
+            {
+                pool.post(&second, [&second, &count, i]() { second.push_back(i); ++count; });
+            }
+        });
+        for (int i = 0; i < 1000; ++i)
+        {
+            pool.post(&first, [&first, &count, i]() { first.push_back(i); ++count; });
+        }
+        producer.join();
+    }
+    ASSERT_EQ(2000, count);
+    for (int i = 0; i < 1000; ++i)
+    {
+        ASSERT_EQ(i, first[std::size_t(i)]);
+        ASSERT_EQ(i, second[std::size_t(i)]);
+    }
+}
+
+TEST(xexecutor, observe_async)
+{
+    Foo foo;
+    std::vector<int> values;
+    std::thread::id caller = std::this_thread::get_id(), callee;
+    {
+        xp::xworker_pool pool(2);
+        XOBSERVE_ASYNC(foo, bar, pool, ([&values, &callee](const Foo&, int value) { values.push_back(value); callee = std::this_thread::get_id(); }));
+        for (int i = 1; i <= 100; ++i)
+        {
+            foo.bar = i;
+        }
+    }
+    ASSERT_EQ(100u, values.size());
+    for (int i = 0; i < 100; ++i)
+    {
+        ASSERT_EQ(i + 1, values[std::size_t(i)]);
+    }
+    ASSERT_NE(caller, callee);
+}
+
+TEST(xexecutor, throwing_observer)
+{
+    Foo foo;
+    std::atomic<int> count(0);
+    xp::xworker_pool pool(2);
+    XOBSERVE_ASYNC(foo, bar, pool, ([](const Foo&, int value) { if (value % 2 == 0) { throw std::runtime_error("observer"); } }));
+    XOBSERVE_ASYNC(foo, bar, pool, ([&count](const Foo&, int) { ++count; }));
+    for (int i = 1; i <= 10; ++i)
+    {
+        foo.bar = i;
+    }
+
+    // The workers keep running the tasks, and the first exception is rethrown once
+    ASSERT_THROW(pool.drain(), std::runtime_error);
+    ASSERT_EQ(10, count);
+    pool.drain();
+
+    foo.bar = 11;
+    pool.drain();
+    ASSERT_EQ(11, count);
+}
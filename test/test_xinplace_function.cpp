@@ -0,0 +1,75 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <functional>
+#include <memory>
+
+#include "xproperty/xinplace_function.hpp"
+
+namespace
+{
+
+struct counted
+{
+    counted(int& alive) : p_alive(&alive) { ++*p_alive; }
+    counted(const counted& rhs) noexcept : p_alive(rhs.p_alive) { ++*p_alive; }
+    ~counted() { --*p_alive; }
+
+    int operator()(int i) const { return i + 1; }
+
+    int* p_alive;
+};
+
+}
+
+TEST(xinplace_function, invoke)
+{
+    int a = 1, b = 2;
+    xp::xinplace_function<int(int)> f = [&a, &b](int i) { return a + b + i; };
+    ASSERT_TRUE(static_cast<bool>(f));
+    ASSERT_EQ(6, f(3));
+
+    xp::xinplace_function<int(int)> g;
+    ASSERT_FALSE(static_cast<bool>(g));
+    ASSERT_THROW(g(0), std::bad_function_call);
+}
+
+TEST(xinplace_function, copy_and_move)
+{
+    int alive = 0;
+    {
+        xp::xinplace_function<int(int)> f = counted(alive);
+        ASSERT_EQ(1, alive);
+
+        xp::xinplace_function<int(int)> g = f;
+        ASSERT_EQ(2, alive);
+        ASSERT_EQ(2, g(1));
+
+        xp::xinplace_function<int(int)> h = std::move(f);
+        ASSERT_EQ(2, alive);
+        ASSERT_FALSE(static_cast<bool>(f));
+        ASSERT_EQ(2, h(1));
+
+        g = nullptr;
+        ASSERT_EQ(1, alive);
+    }
+    ASSERT_EQ(0, alive);
+}
+
+TEST(xinplace_function, mutable_state)
+{
+    int calls = 0;
+    auto counter = std::make_shared<int>(0);
+    xp::xinplace_function<void()> f = [counter, &calls]() { ++*counter; ++calls; };
+    f();
+    f();
+    ASSERT_EQ(2, *counter);
+    ASSERT_EQ(2, calls);
+}
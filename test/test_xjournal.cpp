@@ -0,0 +1,116 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xproperty/xjournal.hpp"
+#include "xproperty/xobserved.hpp"
+
+namespace
+{
+
+struct Audited : public xp::xobserved<Audited>
+{
+    XPROPERTY(double, Audited, bar);
+    XPROPERTY(std::string, Audited, label);
+};
+
+}
+
+TEST(xjournal, observed)
+{
+    xp::xjournal journal(16);
+    Audited audited, other;
+    audited.set_journal(&journal);
+
+    audited.bar = 1.5;
+    audited.label = "label";
+    other.bar = 2.0;
+    audited.set_journal(nullptr);
+    audited.bar = 3.0;
+
+    std::vector<xp::xjournal_entry> entries;
+    ASSERT_EQ(2u, journal.drain([&entries](const xp::xjournal_entry& e) { entries.push_back(e); }));
+    ASSERT_EQ(&audited, entries[0].object);
+    ASSERT_EQ(xoffsetof(Audited, bar), entries[0].offset);
+    ASSERT_EQ(sizeof(double), entries[0].value_size);
+    double value;
+    std::memcpy(&value, entries[0].value, sizeof(double));
+    ASSERT_EQ(1.5, value);
+    ASSERT_EQ(xoffsetof(Audited, label), entries[1].offset);
+    ASSERT_EQ(0u, entries[1].value_size);
+    ASSERT_LE(entries[0].timestamp, entries[1].timestamp);
+}
+
+TEST(xjournal, full)
+{
+    xp::xjournal journal(3);
+    ASSERT_EQ(4u, journal.capacity());
+    for (int i = 0; i < 6; ++i)
+    {
+        journal.append(nullptr, 0, i);
+    }
+    ASSERT_EQ(2u, journal.dropped());
+
+    std::vector<int> values;
+    journal.drain([&values](const xp::xjournal_entry& e) {
+        int value;
+        std::memcpy(&value, e.value, sizeof(int));
+        values.push_back(value);
+    });
+    ASSERT_EQ(std::vector<int>({ 0, 1, 2, 3 }), values);
+
+    ASSERT_TRUE(journal.append(nullptr, 0, 6));
+    xp::xjournal_entry entry;
+    ASSERT_TRUE(journal.pop(entry));
+    ASSERT_FALSE(journal.pop(entry));
+}
+
+TEST(xjournal, concurrent)
+{
+    constexpr int producers = 4;
+    constexpr int changes = 10000;
+    xp::xjournal journal(1024);
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&journal, p]() {
+            for (int i = 0; i < changes; ++i)
+            {
+                while (!journal.append(nullptr, std::size_t(p), i))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // Changes of each producer are drained in order
+    std::vector<int> last(producers, -1);
+    int drained = 0;
+    while (drained != producers * changes)
+    {
+        drained += int(journal.drain([&last](const xp::xjournal_entry& e) {
+            int value;
+            std::memcpy(&value, e.value, sizeof(int));
+            EXPECT_EQ(last[e.offset] + 1, value);
+            last[e.offset] = value;
+        }));
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    ASSERT_EQ(std::vector<int>(producers, changes - 1), last);
+}
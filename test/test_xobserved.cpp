@@ -8,18 +8,79 @@
 
 #include "gtest/gtest.h"
 
+#include <cmath>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <stdexcept>
 
 #include "xproperty/xobserved.hpp"
 
+namespace
+{
+
 struct Foo : public xp::xobserved<Foo>
 {
     XPROPERTY(double, Foo, bar);
     XPROPERTY(double, Foo, baz);
 };
 
+// Large value type counting its deep copies
+
+struct counted_vector
+{
+    counted_vector() = default;
+    counted_vector(std::size_t size) : m_data(size) {}
+
+    counted_vector(const counted_vector& rhs) : m_data(rhs.m_data) { ++copies; }
+    counted_vector& operator=(const counted_vector& rhs) { m_data = rhs.m_data; ++copies; return *this; }
+
+    counted_vector(counted_vector&&) = default;
+    counted_vector& operator=(counted_vector&&) = default;
+
+    std::vector<double> m_data;
+
+    static int copies;
+};
+
+int counted_vector::copies = 0;
+
+struct Large : public xp::xobserved<Large>
+{
+    XPROPERTY(counted_vector, Large, values);
+};
+
+struct approx_equal
+{
+    bool operator()(double lhs, double rhs) const
+    {
+        return std::abs(lhs - rhs) < 1e-6;
+    }
+};
+
+struct Gated : public xp::xobserved<Gated>
+{
+    XPROPERTY_GATED(double, Gated, bar);
+    XPROPERTY_GATED_CMP(double, Gated, baz, approx_equal);
+};
+
+// Properties declared in a CRTP base
+
+template <class D>
+struct Base : public xp::xobserved<D>
+{
+    XPROPERTY(double, D, bar);
+};
+
+struct Derived : public Base<Derived>
+{
+    XPROPERTY(double, Derived, baz);
+};
+
+}
+
 TEST(xobserved, basic)
 {
     Foo foo;
@@ -70,3 +131,535 @@ TEST(xobserved, links)
     source.bar = 2.0;
     ASSERT_EQ(2.0, target.baz);
 }
+
+TEST(xobserved, property_index)
+{
+    static_assert(xp::xproperty_count<Foo>::value == 2, "Foo has two properties");
+    static_assert(decltype(Foo::bar)::index() == 0, "bar is the first property");
+    static_assert(decltype(Foo::baz)::index() == 1, "baz is the second property");
+    static_assert(xp::xproperty_index_of<Foo, xoffsetof(Foo, baz)>::value == 1, "baz is found at its offset");
+    static_assert(std::is_same<xp::xproperty_type<Foo, 0>, decltype(Foo::bar)>::value, "bar is the property of index 0");
+}
+
+TEST(xobserved, base_properties)
+{
+    static_assert(xp::xproperty_count<Derived>::value == 2, "Derived has two properties");
+    static_assert(decltype(Derived::bar)::index() == 0, "bar is the first property");
+    static_assert(decltype(Derived::baz)::index() == 1, "baz is the second property");
+    static_assert(std::is_same<xp::xproperty_type<Derived, 0>, decltype(Derived::bar)>::value, "bar is the property of index 0");
+
+    Derived d;
+    int bar_count = 0, baz_count = 0;
+    XOBSERVE(d, bar, [&](const Derived&) { ++bar_count; });
+    XOBSERVE(d, baz, [&](const Derived&) { ++baz_count; });
+    d.bar = 1.0;
+    d.baz = 2.0;
+    ASSERT_EQ(1, bar_count);
+    ASSERT_EQ(1, baz_count);
+
+    d.track_dirty();
+    d.clear_dirty();
+    d.bar = 3.0;
+    ASSERT_TRUE(d.dirty<xoffsetof(Derived, bar)>());
+    ASSERT_FALSE(d.dirty<xoffsetof(Derived, baz)>());
+}
+
+TEST(xobserved, for_each_property)
+{
+    constexpr auto descriptors = xp::xproperty_descriptors<Foo>::value;
+    static_assert(descriptors.size() == 2, "Foo has two descriptors");
+    static_assert(descriptors[1].offset == xoffsetof(Foo, baz), "baz is the second descriptor");
+    ASSERT_EQ(std::string("bar"), descriptors[0].name);
+    ASSERT_EQ(std::string("baz"), decltype(Foo::baz)::name());
+
+    Foo foo;
+    int count = 0;
+    XOBSERVE(foo, baz, [&count](const Foo&) { ++count; });
+    xp::for_each_property(foo, [](auto& p) {
+        using property_type = std::decay_t<decltype(p)>;
+        p = double(property_type::index() + 1);
+    });
+    ASSERT_EQ(1.0, foo.bar);
+    ASSERT_EQ(2.0, foo.baz);
+    ASSERT_EQ(1, count);
+
+    const Foo& cfoo = foo;
+    std::vector<std::string> names;
+    double sum = 0.;
+    xp::for_each_property(cfoo, [&](const auto& p) {
+        names.push_back(p.name());
+        sum += p;
+    });
+    ASSERT_EQ(std::vector<std::string>({ "bar", "baz" }), names);
+    ASSERT_EQ(3.0, sum);
+}
+
+TEST(xobserved, dirty)
+{
+    Foo foo;
+    foo.bar = 1.0;
+    ASSERT_FALSE(foo.dirty());
+
+    foo.track_dirty();
+    ASSERT_FALSE(foo.dirty());
+    foo.baz = 2.0;
+    ASSERT_TRUE(foo.dirty());
+    ASSERT_FALSE(foo.dirty<xoffsetof(Foo, bar)>());
+    ASSERT_TRUE(foo.dirty<xoffsetof(Foo, baz)>());
+
+    {
+        auto hold = xp::hold_notifications(foo);
+        foo.bar = 3.0;
+    }
+    std::vector<std::string> names;
+    foo.for_each_dirty([&names](const auto& p) { names.push_back(p.name()); });
+    ASSERT_EQ(std::vector<std::string>({ "bar", "baz" }), names);
+
+    foo.clear_dirty();
+    ASSERT_FALSE(foo.dirty());
+    names.clear();
+    foo.for_each_dirty([&names](const auto& p) { names.push_back(p.name()); });
+    ASSERT_TRUE(names.empty());
+}
+
+TEST(xobserved, footprint)
+{
+    // Observers and validators live in a side table allocated on demand
+    ASSERT_EQ(sizeof(void*) + 2 * sizeof(double), sizeof(Foo));
+}
+
+TEST(xobserved, unobserve)
+{
+    Foo foo;
+    int bar_count = 0, baz_count = 0;
+    XOBSERVE(foo, bar, [&bar_count](const Foo&) { ++bar_count; });
+    XOBSERVE(foo, bar, [&bar_count](const Foo&) { ++bar_count; });
+    XOBSERVE(foo, baz, [&baz_count](const Foo&) { ++baz_count; });
+
+    foo.bar = 1.0;
+    foo.baz = 1.0;
+    ASSERT_EQ(2, bar_count);
+    ASSERT_EQ(1, baz_count);
+
+    XUNOBSERVE(foo, bar);
+    foo.bar = 2.0;
+    foo.baz = 2.0;
+    ASSERT_EQ(2, bar_count);
+    ASSERT_EQ(2, baz_count);
+}
+
+TEST(xobserved, many_observers)
+{
+    // Observers beyond the inline nodes of the table are allocated on the heap
+    Foo foo;
+    int count = 0;
+    for (int i = 0; i < XPROPERTY_INLINE_OBSERVERS + 1; ++i)
+    {
+        XOBSERVE(foo, bar, [&count](const Foo&) { ++count; });
+    }
+    for (int i = 0; i < XPROPERTY_INLINE_OBSERVERS; ++i)
+    {
+        XOBSERVE(foo, baz, [&count](const Foo&) { ++count; });
+    }
+    Foo copy = foo;
+    foo.bar = 1.0;
+    copy.bar = 1.0;
+    ASSERT_EQ(2 * (XPROPERTY_INLINE_OBSERVERS + 1), count);
+
+    XUNOBSERVE(foo, bar);
+    XOBSERVE(foo, bar, [&count](const Foo&) { ++count; });
+    foo.bar = 2.0;
+    foo.baz = 2.0;
+    ASSERT_EQ(2 * (XPROPERTY_INLINE_OBSERVERS + 1) + 1 + XPROPERTY_INLINE_OBSERVERS, count);
+}
+
+TEST(xobserved, gated)
+{
+    Gated gated;
+    int observed = 0, validated = 0;
+    XOBSERVE(gated, bar, [&observed](const Gated&) { ++observed; });
+    XVALIDATE(gated, bar, [&validated](const Gated&, double proposal) { ++validated; return proposal; });
+
+    gated.bar = 1.0;
+    gated.bar = 1.0;
+    ASSERT_EQ(1, observed);
+    ASSERT_EQ(1, validated);
+    gated.bar = 2.0;
+    ASSERT_EQ(2, observed);
+    ASSERT_EQ(2, validated);
+
+    XOBSERVE(gated, baz, [&observed](const Gated&) { ++observed; });
+    gated.baz = 1e-9;
+    ASSERT_EQ(2, observed);
+    ASSERT_EQ(0.0, gated.baz);
+    gated.baz = 1.0;
+    ASSERT_EQ(3, observed);
+}
+
+TEST(xobserved, validator_value_category)
+{
+    Foo foo;
+    int validated = 0;
+    XVALIDATE(foo, bar, [&validated](const Foo&, double proposal) { ++validated; return proposal; });
+
+    double value = 1.0;
+    foo.bar = value;
+    foo.bar = 2.0;
+    foo.bar = 3;
+    ASSERT_EQ(3, validated);
+    ASSERT_EQ(3.0, foo.bar);
+
+    Foo copy = foo;
+    copy.bar = 4.0;
+    ASSERT_EQ(4, validated);
+}
+
+TEST(xobserved, connection)
+{
+    Foo foo;
+    int first = 0, second = 0;
+    {
+        xp::connection c1 = XCONNECT(foo, bar, [&first](const Foo&) { ++first; });
+        xp::connection c2 = XCONNECT(foo, bar, [&second](const Foo&) { ++second; });
+        foo.bar = 1.0;
+        ASSERT_EQ(1, first);
+        ASSERT_EQ(1, second);
+
+        c1.disconnect();
+        ASSERT_FALSE(c1.connected());
+        foo.bar = 2.0;
+        ASSERT_EQ(1, first);
+        ASSERT_EQ(2, second);
+
+        xp::connection c3 = std::move(c2);
+        ASSERT_FALSE(c2.connected());
+        ASSERT_TRUE(c3.connected());
+        foo.bar = 3.0;
+        ASSERT_EQ(3, second);
+    }
+    foo.bar = 4.0;
+    ASSERT_EQ(1, first);
+    ASSERT_EQ(3, second);
+}
+
+TEST(xobserved, connection_lifetime)
+{
+    xp::connection c;
+    int count = 0;
+    {
+        Foo foo;
+        auto once = [&count, &c](const Foo&) { ++count; c.disconnect(); };
+        c = XCONNECT(foo, bar, once);
+        foo.bar = 1.0;
+        foo.bar = 2.0;
+        ASSERT_EQ(1, count);
+
+        c = XCONNECT(foo, bar, [&count](const Foo&) { ++count; });
+        XOBSERVE(foo, bar, [&count](const Foo&) { ++count; });
+        Foo copy = foo;
+        copy.bar = 3.0;
+        ASSERT_EQ(2, count);
+    }
+    ASSERT_FALSE(c.connected());
+}
+
+TEST(xobserved, disconnect_while_notifying)
+{
+    Foo foo;
+    std::vector<int> calls;
+    xp::connection first, third, fourth;
+    std::unique_ptr<xp::connection> second;
+
+    // The first observer disconnects itself and the third one, and destroys the
+    // connection of the next one
+    first = XCONNECT(foo, bar, [&](const Foo&) {
+        calls.push_back(1);
+        first.disconnect();
+        second.reset();
+        third.disconnect();
+    });
+    second = std::make_unique<xp::connection>(XCONNECT(foo, bar, [&calls](const Foo&) { calls.push_back(2); }));
+    third = XCONNECT(foo, bar, [&calls](const Foo&) { calls.push_back(3); });
+    fourth = XCONNECT(foo, bar, [&calls](const Foo&) { calls.push_back(4); });
+    XOBSERVE(foo, bar, [&calls](const Foo&) { calls.push_back(5); });
+
+    foo.bar = 1.0;
+    ASSERT_EQ(std::vector<int>({ 1, 4, 5 }), calls);
+    calls.clear();
+    foo.bar = 2.0;
+    ASSERT_EQ(std::vector<int>({ 4, 5 }), calls);
+}
+
+TEST(xobserved, unobserve_while_notifying)
+{
+    Foo foo;
+    int count = 0;
+    xp::connection c = XCONNECT(foo, bar, [&count](const Foo&) { ++count; });
+    XOBSERVE(foo, bar, [&](const Foo&) {
+        ++count;
+        XUNOBSERVE(foo, bar);
+        // Observers registered during the notification are invoked from the next one
+        XOBSERVE(foo, bar, [&count](const Foo&) { count += 10; });
+    });
+    XOBSERVE(foo, bar, [&count](const Foo&) { ++count; });
+
+    foo.bar = 1.0;
+    ASSERT_EQ(2, count);
+    ASSERT_FALSE(c.connected());
+    foo.bar = 2.0;
+    ASSERT_EQ(12, count);
+}
+
+TEST(xobserved, nested_notifications)
+{
+    // An observer assigning its own property notifies the other observers again,
+    // while the outer notification goes on
+    Foo foo;
+    std::vector<double> values;
+    xp::connection c;
+    XOBSERVE(foo, bar, [&](const Foo&) {
+        if (foo.bar < 2.0)
+        {
+            foo.bar = foo.bar + 1.0;
+            c.disconnect();
+        }
+    });
+    c = XCONNECT(foo, bar, [&values](const Foo& f) { values.push_back(f.bar); });
+
+    foo.bar = 0.0;
+    ASSERT_EQ(std::vector<double>({ 2.0 }), values);
+}
+
+TEST(xobserved, type_level)
+{
+    Foo foo1, foo2;
+    int observed = 0;
+    XOBSERVE_ALL(Foo, bar, [&observed](const Foo&) { ++observed; });
+    XVALIDATE_ALL(Foo, bar, [](const Foo&, double proposal) { return proposal < 0.0 ? 0.0 : proposal; });
+
+    foo1.bar = 1.0;
+    foo2.bar = -1.0;
+    ASSERT_EQ(2, observed);
+    ASSERT_EQ(0.0, foo2.bar);
+
+    // Type-level validators run before instance-level ones
+    XVALIDATE(foo1, bar, [](const Foo&, double proposal) { return proposal - 1.0; });
+    foo1.bar = -1.0;
+    ASSERT_EQ(-1.0, foo1.bar);
+
+    XUNOBSERVE_ALL(Foo, bar);
+    XUNVALIDATE_ALL(Foo, bar);
+    foo2.bar = -2.0;
+    ASSERT_EQ(3, observed);
+    ASSERT_EQ(-2.0, foo2.bar);
+}
+
+TEST(xobserved, hold_notifications)
+{
+    Foo foo;
+    int bar_count = 0, baz_count = 0, validated = 0;
+    XOBSERVE(foo, bar, [&bar_count](const Foo&) { ++bar_count; });
+    XOBSERVE(foo, baz, [&baz_count](const Foo&) { ++baz_count; });
+    XVALIDATE(foo, bar, [&validated](const Foo&, double proposal) { ++validated; return proposal; });
+    {
+        auto hold = xp::hold_notifications(foo);
+        foo.bar = 1.0;
+        foo.bar = 2.0;
+        {
+            auto nested = xp::hold_notifications(foo);
+            foo.bar = 3.0;
+        }
+        ASSERT_EQ(0, bar_count);
+        ASSERT_EQ(3, validated);
+        ASSERT_EQ(3.0, foo.bar);
+    }
+    ASSERT_EQ(1, bar_count);
+    ASSERT_EQ(0, baz_count);
+
+    foo.baz = 1.0;
+    ASSERT_EQ(1, baz_count);
+}
+
+TEST(xobserved, change_observer_connected_during_hold)
+{
+    Foo foo;
+    int observed = 0;
+    double old_value = -1.0, new_value = -1.0;
+    {
+        auto hold = xp::hold_notifications(foo);
+        foo.bar = 1.0;
+        XOBSERVE(foo, bar, ([&](const Foo&, const xp::change<double>& c) {
+            ++observed;
+            old_value = c.old_value;
+            new_value = c.new_value;
+        }));
+        foo.bar = 2.0;
+    }
+    // The previous value was not kept by the first assignment
+    ASSERT_EQ(1, observed);
+    ASSERT_EQ(2.0, old_value);
+    ASSERT_EQ(2.0, new_value);
+
+    foo.bar = 3.0;
+    ASSERT_EQ(2, observed);
+    ASSERT_EQ(2.0, old_value);
+    ASSERT_EQ(3.0, new_value);
+}
+
+TEST(xobserved, hold_throwing_observer)
+{
+    Foo foo;
+    int baz_count = 0;
+    XOBSERVE(foo, bar, [](const Foo&) { throw std::runtime_error("observer"); });
+    XOBSERVE(foo, baz, [&baz_count](const Foo&) { ++baz_count; });
+
+    // The destructor of the hold swallows the exception
+    {
+        auto hold = xp::hold_notifications(foo);
+        foo.bar = 1.0;
+        foo.baz = 1.0;
+    }
+    ASSERT_EQ(1, baz_count);
+
+    // Releasing the hold propagates it, once the other properties are notified
+    auto hold = xp::hold_notifications(foo);
+    foo.bar = 2.0;
+    foo.baz = 2.0;
+    ASSERT_THROW(hold.release(), std::runtime_error);
+    ASSERT_EQ(2, baz_count);
+    foo.baz = 3.0;
+    ASSERT_EQ(3, baz_count);
+}
+
+TEST(xobserved, bidirectional_links)
+{
+    Foo source, target;
+    int source_count = 0, target_count = 0;
+    source.bar = 1.0;
+    XLINK(source, bar, target, baz);
+    XOBSERVE(source, bar, [&source_count](const Foo&) { ++source_count; });
+    XOBSERVE(target, baz, [&target_count](const Foo&) { ++target_count; });
+    ASSERT_EQ(1.0, target.baz);
+
+    source.bar = 2.0;
+    ASSERT_EQ(2.0, target.baz);
+    ASSERT_EQ(1, source_count);
+    ASSERT_EQ(1, target_count);
+
+    target.baz = 3.0;
+    ASSERT_EQ(3.0, source.bar);
+    ASSERT_EQ(2, source_count);
+    ASSERT_EQ(2, target_count);
+}
+
+TEST(xobserved, move_aware_assignment)
+{
+    Large large;
+    XVALIDATE(large, values, [](const Large&, counted_vector proposal) { proposal.m_data.push_back(0.0); return proposal; });
+    XVALIDATE(large, values, [](const Large&, counted_vector proposal) { return proposal; });
+    XOBSERVE(large, values, [](const Large&) {});
+
+    counted_vector::copies = 0;
+    large.values = counted_vector(1000);
+    ASSERT_EQ(0, counted_vector::copies);
+    ASSERT_EQ(1001u, static_cast<const counted_vector&>(large.values).m_data.size());
+
+    counted_vector lvalue(10);
+    large.values = lvalue;
+    ASSERT_EQ(1, counted_vector::copies);
+}
+
+TEST(xobserved, change_observer)
+{
+    Foo foo;
+    foo.bar = 1.0;
+    double old_value = 0.0, new_value = 0.0;
+    int observed = 0;
+    XOBSERVE(foo, bar, [&](const Foo&, const xp::change<double>& c) { old_value = c.old_value; new_value = c.new_value; });
+    XOBSERVE(foo, bar, [&observed](const Foo&) { ++observed; });
+
+    foo.bar = 2.0;
+    ASSERT_EQ(1.0, old_value);
+    ASSERT_EQ(2.0, new_value);
+    ASSERT_EQ(1, observed);
+
+    {
+        auto hold = xp::hold_notifications(foo);
+        foo.bar = 3.0;
+        foo.bar = 4.0;
+    }
+    ASSERT_EQ(2.0, old_value);
+    ASSERT_EQ(4.0, new_value);
+    ASSERT_EQ(2, observed);
+
+    {
+        xp::connection c = XCONNECT(foo, baz, [&](const Foo&, const xp::change<double>& ch) { old_value = ch.old_value; });
+        ASSERT_TRUE(foo.requires_old_value<xoffsetof(Foo, baz)>());
+        foo.baz = 5.0;
+        ASSERT_EQ(0.0, old_value);
+    }
+    ASSERT_FALSE(foo.requires_old_value<xoffsetof(Foo, baz)>());
+}
+
+TEST(xobserved, old_value_only_kept_on_demand)
+{
+    Large large;
+    XOBSERVE(large, values, [](const Large&) {});
+    counted_vector::copies = 0;
+    large.values = counted_vector(10);
+    ASSERT_FALSE(large.requires_old_value<xoffsetof(Large, values)>());
+
+    std::size_t old_size = 0;
+    XOBSERVE(large, values, [&old_size](const Large&, const xp::change<counted_vector>& c) { old_size = c.old_value.m_data.size(); });
+    large.values = counted_vector(20);
+    ASSERT_EQ(10u, old_size);
+    ASSERT_EQ(0, counted_vector::copies);
+
+    XUNOBSERVE(large, values);
+    ASSERT_FALSE(large.requires_old_value<xoffsetof(Large, values)>());
+}
+
+namespace
+{
+
+// Static callbacks running before the dynamic ones
+
+struct Hybrid : public xp::xobserved<Hybrid>
+{
+    MAKE_HYBRID_OBSERVED()
+
+    XPROPERTY(double, Hybrid, bar);
+    XPROPERTY(double, Hybrid, baz);
+
+    mutable std::vector<int> notifications;
+};
+
+XVALIDATE_STATIC(double, Hybrid, bar, proposal)
+{
+    return proposal < 0.0 ? 0.0 : proposal;
+}
+
+XOBSERVE_STATIC(double, Hybrid, bar)
+{
+    notifications.push_back(0);
+}
+
+}
+
+TEST(xobserved, hybrid)
+{
+    Hybrid hybrid;
+    hybrid.bar = -1.0;
+    ASSERT_EQ(0.0, hybrid.bar);
+    ASSERT_EQ(std::vector<int>({ 0 }), hybrid.notifications);
+
+    XVALIDATE(hybrid, bar, [](const Hybrid&, double proposal) { return proposal + 1.0; });
+    XOBSERVE(hybrid, bar, [](const Hybrid& h) { h.notifications.push_back(1); });
+    hybrid.bar = -2.0;
+    ASSERT_EQ(1.0, hybrid.bar);
+    ASSERT_EQ(std::vector<int>({ 0, 0, 1 }), hybrid.notifications);
+
+    hybrid.baz = 1.0;
+    ASSERT_EQ(3u, hybrid.notifications.size());
+    ASSERT_EQ(sizeof(void*) + 2 * sizeof(double) + sizeof(std::vector<int>), sizeof(Hybrid));
+}
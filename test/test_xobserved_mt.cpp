@@ -0,0 +1,196 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "xproperty/xobserved_mt.hpp"
+
+namespace
+{
+
+struct Foo : public xp::xobserved_mt<Foo>
+{
+    XPROPERTY(double, Foo, bar);
+    XPROPERTY(double, Foo, baz);
+};
+
+// Runs a hook when assigned, between the start of an assignment and the
+// notification of the observers.
+struct hooked
+{
+    hooked(int v = 0) : value(v) {}
+    hooked(const hooked&) = default;
+    hooked(hooked&&) = default;
+
+    hooked& operator=(const hooked& rhs)
+    {
+        value = rhs.value;
+        if (hook)
+        {
+            std::function<void()> f = std::move(hook);
+            hook = nullptr;
+            f();
+        }
+        return *this;
+    }
+
+    hooked& operator=(hooked&& rhs)
+    {
+        return *this = static_cast<const hooked&>(rhs);
+    }
+
+    bool operator==(const hooked& rhs) const { return value == rhs.value; }
+    bool operator!=(const hooked& rhs) const { return value != rhs.value; }
+
+    int value;
+    static std::function<void()> hook;
+};
+
+std::function<void()> hooked::hook;
+
+struct Hooked : public xp::xobserved_mt<Hooked>
+{
+    XPROPERTY(hooked, Hooked, bar);
+};
+
+}
+
+TEST(xobserved_mt, basic)
+{
+    Foo foo;
+    int observed = 0;
+    double old_value = -1.0;
+    XOBSERVE(foo, bar, [&observed](const Foo&) { ++observed; });
+    XOBSERVE(foo, bar, [&old_value](const Foo&, const xp::change<double>& c) { old_value = c.old_value; });
+    XVALIDATE(foo, bar, [](const Foo&, double proposal) { return proposal < 0.0 ? 0.0 : proposal; });
+
+    foo.bar = 1.0;
+    ASSERT_EQ(1, observed);
+    ASSERT_EQ(0.0, old_value);
+
+    foo.bar = -1.0;
+    ASSERT_EQ(0.0, foo.bar);
+    ASSERT_EQ(1.0, old_value);
+
+    Foo copy = foo;
+    copy.bar = 2.0;
+    ASSERT_EQ(3, observed);
+
+    XUNOBSERVE(foo, bar);
+    XUNVALIDATE(foo, bar);
+    foo.bar = -2.0;
+    ASSERT_EQ(3, observed);
+    ASSERT_EQ(-2.0, foo.bar);
+    ASSERT_TRUE(foo.requires_old_value<xoffsetof(Foo, bar)>());
+}
+
+TEST(xobserved_mt, unobserve_from_observer)
+{
+    Foo foo;
+    int observed = 0;
+    XOBSERVE(foo, bar, [&observed](const Foo& f) { ++observed; const_cast<Foo&>(f).unobserve<xoffsetof(Foo, bar)>(); });
+    foo.bar = 1.0;
+    foo.bar = 2.0;
+    ASSERT_EQ(1, observed);
+}
+
+TEST(xobserved_mt, concurrent_registration)
+{
+    Foo foo;
+    std::atomic<int> observed(0);
+    std::atomic<bool> done(false);
+
+    std::thread writer([&foo, &done]() {
+        for (int i = 0; i < 20000; ++i)
+        {
+            foo.bar = double(i);
+        }
+        done = true;
+    });
+
+    while (!done)
+    {
+        XOBSERVE(foo, bar, [&observed](const Foo&) { ++observed; });
+        XUNOBSERVE(foo, bar);
+    }
+    writer.join();
+
+    XOBSERVE(foo, bar, [&observed](const Foo&) { ++observed; });
+    int before = observed;
+    foo.bar = -1.0;
+    ASSERT_EQ(before + 1, observed);
+}
+
+TEST(xobserved_mt, observer_connected_during_assignment)
+{
+    Hooked h;
+    int old_value = -1;
+    hooked::hook = [&h, &old_value]() {
+        XOBSERVE(h, bar, [&old_value](const Hooked&, const xp::change<hooked>& c) { old_value = c.old_value.value; });
+    };
+    h.bar = hooked(1);
+    ASSERT_EQ(0, old_value);
+}
+
+TEST(xobserved_mt, reclamation_under_overlapping_readers)
+{
+    struct gate
+    {
+        std::atomic<int> inside = { 0 };
+        std::atomic<bool> release_bar = { false };
+        std::atomic<bool> release_baz = { false };
+    };
+
+    Foo foo;
+    gate g;
+    auto token = std::make_shared<int>(0);
+    XOBSERVE(foo, bar, ([&g, token](const Foo&) {
+        ++g.inside;
+        while (!g.release_bar)
+        {
+            std::this_thread::yield();
+        }
+    }));
+    XOBSERVE(foo, baz, [&g](const Foo&) {
+        ++g.inside;
+        while (!g.release_baz)
+        {
+            std::this_thread::yield();
+        }
+    });
+    auto wait_inside = [&g](int n) {
+        while (g.inside != n)
+        {
+            std::this_thread::yield();
+        }
+    };
+
+    // The second reader enters before the first one leaves, the readers are
+    // never all gone.
+    std::thread first([&foo]() { foo.bar = 1.0; });
+    wait_inside(1);
+    XVALIDATE(foo, bar, [](const Foo&, double proposal) { return proposal; });
+    std::thread second([&foo]() { foo.baz = 1.0; });
+    wait_inside(2);
+    g.release_bar = true;
+    first.join();
+
+    // The snapshot replaced while the first reader was in flight is gone.
+    XUNVALIDATE(foo, bar);
+    ASSERT_EQ(3, token.use_count());
+
+    g.release_baz = true;
+    second.join();
+    XUNVALIDATE(foo, bar);
+    ASSERT_EQ(2, token.use_count());
+}
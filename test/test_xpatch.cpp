@@ -0,0 +1,196 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "xproperty/xatomic_property.hpp"
+#include "xproperty/xdelta.hpp"
+#include "xproperty/xobserved.hpp"
+#include "xproperty/xpatch.hpp"
+
+namespace
+{
+
+struct Rect : public xp::xobserved<Rect>
+{
+    XPROPERTY(int, Rect, width);
+    XPROPERTY(int, Rect, height);
+    XPROPERTY_GATED(std::string, Rect, label);
+    XPROPERTY_ATOMIC(int, Rect, count);
+};
+
+// Value whose move assignment throws for a specific value, to exercise the rollback
+
+struct fragile
+{
+    fragile(int v = 0) : value(v) {}
+
+    fragile(const fragile&) = default;
+    fragile& operator=(const fragile&) = default;
+
+    fragile(fragile&& rhs) : value(rhs.value) {}
+
+    fragile& operator=(fragile&& rhs)
+    {
+        if (rhs.value == -1)
+        {
+            throw std::runtime_error("fragile value");
+        }
+        value = rhs.value;
+        return *this;
+    }
+
+    int value;
+};
+
+struct Fragile : public xp::xobserved<Fragile>
+{
+    XPROPERTY(int, Fragile, first);
+    XPROPERTY(fragile, Fragile, second);
+};
+
+}
+
+TEST(xpatch, apply)
+{
+    Rect rect;
+    rect.width = 1;
+    rect.height = 2;
+
+    std::vector<int> areas;
+    auto record_area = [&areas](const Rect& r) { areas.push_back(r.width * r.height); };
+    XOBSERVE(rect, width, record_area);
+    XOBSERVE(rect, height, record_area);
+    XVALIDATE(rect, height, [](const Rect&, int proposal) { return proposal < 0 ? 0 : proposal; });
+
+    xp::xpatch<Rect> patch;
+    ASSERT_TRUE(patch.empty());
+    XPATCH(patch, width, 3);
+    XPATCH(patch, height, 5);
+    XPATCH(patch, height, 4);
+    XPATCH(patch, count, 7);
+    ASSERT_FALSE(patch.empty());
+
+    xp::apply_patch(rect, patch);
+    ASSERT_TRUE(patch.empty());
+    ASSERT_EQ(3, rect.width);
+    ASSERT_EQ(4, rect.height);
+    ASSERT_EQ(7, rect.count.load());
+    // One notification per property, each seeing the whole patch
+    ASSERT_EQ(std::vector<int>({ 12, 12 }), areas);
+}
+
+TEST(xpatch, old_values)
+{
+    Rect rect;
+    rect.width = 1;
+    int old_width = 0, new_width = 0;
+    XOBSERVE(rect, width, ([&](const Rect&, const xp::change<int>& c) { old_width = c.old_value; new_width = c.new_value; }));
+
+    xp::xpatch<Rect> patch;
+    XPATCH(patch, width, 2);
+    xp::apply_patch(rect, patch);
+    ASSERT_EQ(1, old_width);
+    ASSERT_EQ(2, new_width);
+}
+
+TEST(xpatch, gated)
+{
+    Rect rect;
+    rect.label = "label";
+    int observed = 0;
+    XOBSERVE(rect, label, [&observed](const Rect&) { ++observed; });
+
+    xp::xpatch<Rect> patch;
+    XPATCH(patch, label, "label");
+    xp::apply_patch(rect, patch);
+    ASSERT_EQ(0, observed);
+}
+
+TEST(xpatch, throwing_observer)
+{
+    Rect rect;
+    int observed = 0;
+    XOBSERVE(rect, width, [](const Rect&) { throw std::runtime_error("observer"); });
+    XOBSERVE(rect, height, [&observed](const Rect&) { ++observed; });
+
+    // The patch remains applied, and the other properties are notified
+    xp::xpatch<Rect> patch;
+    XPATCH(patch, width, 2);
+    XPATCH(patch, height, 3);
+    ASSERT_THROW(xp::apply_patch(rect, patch), std::runtime_error);
+    ASSERT_TRUE(patch.empty());
+    ASSERT_EQ(2, rect.width);
+    ASSERT_EQ(3, rect.height);
+    ASSERT_EQ(1, observed);
+}
+
+TEST(xpatch, validator_rollback)
+{
+    Rect rect;
+    rect.width = 1;
+    rect.height = 2;
+    int observed = 0;
+    XOBSERVE(rect, width, [&observed](const Rect&) { ++observed; });
+    XVALIDATE(rect, height, [](const Rect&, int proposal) {
+        if (proposal < 0)
+        {
+            throw std::runtime_error("negative height");
+        }
+        return proposal;
+    });
+
+    xp::xpatch<Rect> patch;
+    XPATCH(patch, width, 3);
+    XPATCH(patch, height, -1);
+    ASSERT_THROW(xp::apply_patch(rect, patch), std::runtime_error);
+    ASSERT_TRUE(patch.empty());
+    ASSERT_EQ(1, rect.width);
+    ASSERT_EQ(2, rect.height);
+    ASSERT_EQ(0, observed);
+}
+
+TEST(xpatch, storage_rollback)
+{
+    Fragile f;
+    f.first = 1;
+    int observed = 0;
+    XOBSERVE(f, first, [&observed](const Fragile&) { ++observed; });
+
+    xp::xpatch<Fragile> patch;
+    XPATCH(patch, first, 2);
+    XPATCH(patch, second, fragile(-1));
+    ASSERT_THROW(xp::apply_patch(f, patch), std::runtime_error);
+    ASSERT_EQ(1, f.first);
+    ASSERT_EQ(0, static_cast<const fragile&>(f.second).value);
+    ASSERT_EQ(0, observed);
+}
+
+TEST(xpatch, decode)
+{
+    Rect source;
+    source.track_dirty();
+    source.width = 3;
+    source.label = "label";
+    std::vector<char> buffer;
+    xp::encode_delta(source, buffer);
+
+    Rect target;
+    int observed = 0;
+    XOBSERVE(target, width, [&observed](const Rect&) { ++observed; });
+    xp::xpatch<Rect> patch;
+    ASSERT_EQ(buffer.size(), xp::decode_patch(patch, buffer.data(), buffer.size()));
+    xp::apply_patch(target, patch);
+    ASSERT_EQ(3, target.width);
+    ASSERT_EQ(std::string("label"), static_cast<const std::string&>(target.label));
+    ASSERT_EQ(1, observed);
+}
@@ -9,11 +9,44 @@
 #include "gtest/gtest.h"
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <stdexcept>
 
 #include "xproperty/xobserved.hpp"
 
+// The observed types of the test files live in anonymous namespaces, so that
+// properties of homonymous owners do not violate the one definition rule.
+
+namespace
+{
+
+struct counted_string
+{
+    counted_string() = default;
+    counted_string(const char* str) : m_str(str) {}
+
+    counted_string(const counted_string& rhs) : m_str(rhs.m_str) { ++copies; }
+    counted_string& operator=(const counted_string& rhs) { m_str = rhs.m_str; ++copies; return *this; }
+
+    counted_string(counted_string&&) = default;
+    counted_string& operator=(counted_string&&) = default;
+
+    std::string m_str;
+
+    static int copies;
+};
+
+int counted_string::copies = 0;
+
+struct Text
+{
+    MAKE_OBSERVED()
+
+    XPROPERTY(counted_string, Text, value);
+};
+
 struct Foo
 {
     MAKE_OBSERVED()
@@ -37,12 +70,72 @@ XOBSERVE_STATIC(double, Foo, bar)
     std::cout << "Observer: New value of bar: " << bar << std::endl;
 };
 
+// Several static validators and observers of the same property
+
+struct Chained
+{
+    MAKE_OBSERVED()
+
+    XPROPERTY(int, Chained, value);
+
+    mutable std::vector<int> notifications;
+};
+
+XVALIDATE_STATIC(int, Chained, value, proposal)
+{
+    return proposal < 0 ? 0 : proposal;
+}
+
+XVALIDATE_STATIC(int, Chained, value, proposal)
+{
+    return proposal * 2;
+}
+
+XOBSERVE_STATIC(int, Chained, value)
+{
+    notifications.push_back(1);
+}
+
+XOBSERVE_STATIC(int, Chained, value)
+{
+    notifications.push_back(2);
+}
+
+}
+
 TEST(xproperty, basic)
 {
     Foo foo;
 
     foo.bar = 1.0;
     ASSERT_EQ(1.0, foo.bar);
-    // ASSERT_THROW({ foo.bar = -1.0; }, std::runtime_error);
-    // ASSERT_EQ(1.0, foo.bar);
+    ASSERT_THROW({ foo.bar = -1.0; }, std::runtime_error);
+    ASSERT_EQ(1.0, foo.bar);
+
+    // Lvalue proposals resolve to the same static validator
+    double proposal = -2.0;
+    ASSERT_THROW({ foo.bar = proposal; }, std::runtime_error);
+    ASSERT_EQ(1.0, foo.bar);
+}
+
+TEST(xproperty, multiple_static_callbacks)
+{
+    Chained chained;
+    chained.value = 3;
+    ASSERT_EQ(6, chained.value);
+    chained.value = -1;
+    ASSERT_EQ(0, chained.value);
+    ASSERT_EQ(std::vector<int>({ 1, 2, 1, 2 }), chained.notifications);
+}
+
+TEST(xproperty, move_aware_assignment)
+{
+    Text text;
+    counted_string::copies = 0;
+    text.value = counted_string("a string too long for the small buffer");
+    ASSERT_EQ(0, counted_string::copies);
+
+    counted_string lvalue("a string too long for the small buffer");
+    text.value = lvalue;
+    ASSERT_EQ(1, counted_string::copies);
 }
@@ -0,0 +1,97 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "xproperty/xatomic_property.hpp"
+#include "xproperty/xobserved.hpp"
+#include "xproperty/xproperty_lookup.hpp"
+
+namespace
+{
+
+struct Widget : public xp::xobserved<Widget>
+{
+    XPROPERTY(double, Widget, bar);
+    XPROPERTY(std::string, Widget, label);
+    XPROPERTY(int, Widget, width);
+    XPROPERTY(int, Widget, height);
+    XPROPERTY_ATOMIC(int, Widget, count);
+};
+
+}
+
+TEST(xproperty_lookup, index_of_name)
+{
+    ASSERT_EQ(0u, xp::xproperty_index_of_name<Widget>("bar"));
+    ASSERT_EQ(1u, xp::xproperty_index_of_name<Widget>("label"));
+    ASSERT_EQ(2u, xp::xproperty_index_of_name<Widget>(std::string("width")));
+    ASSERT_EQ(3u, xp::xproperty_index_of_name<Widget>("height"));
+    ASSERT_EQ(4u, xp::xproperty_index_of_name<Widget>("count"));
+    ASSERT_EQ(5u, xp::xproperty_index_of_name<Widget>("heigh"));
+    ASSERT_EQ(5u, xp::xproperty_index_of_name<Widget>("heights"));
+    ASSERT_EQ(5u, xp::xproperty_index_of_name<Widget>(""));
+    ASSERT_EQ(3u, xp::xproperty_index_of_name<Widget>(xp::xproperty_name("heights", 6)));
+}
+
+TEST(xproperty_lookup, set_by_name)
+{
+    Widget widget;
+    int observed = 0;
+    XOBSERVE(widget, width, [&observed](const Widget&) { ++observed; });
+    XVALIDATE(widget, width, [](const Widget&, int proposal) { return proposal < 0 ? 0 : proposal; });
+
+    ASSERT_TRUE(xp::set_by_name(widget, "width", -3));
+    ASSERT_EQ(0, widget.width);
+    ASSERT_EQ(1, observed);
+    ASSERT_TRUE(xp::set_by_name(widget, "label", "a label"));
+    ASSERT_EQ(std::string("a label"), static_cast<const std::string&>(widget.label));
+    ASSERT_TRUE(xp::set_by_name(widget, "count", 2));
+    ASSERT_EQ(2, widget.count.load());
+
+    ASSERT_FALSE(xp::set_by_name(widget, "depth", 1));
+    ASSERT_THROW(xp::set_by_name(widget, "bar", std::string("1.0")), std::invalid_argument);
+}
+
+TEST(xproperty_lookup, get_by_name)
+{
+    Widget widget;
+    widget.bar = 1.5;
+    widget.label = "a label";
+    widget.count = 4;
+
+    double bar = 0.;
+    ASSERT_TRUE(xp::get_by_name(widget, "bar", bar));
+    ASSERT_EQ(1.5, bar);
+    std::string label;
+    ASSERT_TRUE(xp::get_by_name(widget, "label", label));
+    ASSERT_EQ(std::string("a label"), label);
+    int count = 0;
+    ASSERT_TRUE(xp::get_by_name(widget, "count", count));
+    ASSERT_EQ(4, count);
+
+    ASSERT_FALSE(xp::get_by_name(widget, "depth", count));
+    ASSERT_THROW(xp::get_by_name(widget, "label", count), std::invalid_argument);
+}
+
+TEST(xproperty_lookup, visit_property)
+{
+    Widget widget;
+    int visited = 0;
+    auto f = [&visited](const auto&) { ++visited; };
+    using indices = std::make_index_sequence<xp::xproperty_count<Widget>::value>;
+    ASSERT_TRUE(xp::detail::visit_property(widget, 4, f, indices()));
+    ASSERT_EQ(1, visited);
+    ASSERT_FALSE(xp::detail::visit_property(widget, 5, f, indices()));
+    ASSERT_FALSE(xp::detail::visit_property(widget, std::size_t(-1), f, indices()));
+    ASSERT_EQ(1, visited);
+}
@@ -0,0 +1,156 @@
+/***************************************************************************
+* Copyright (c) 2016, Johan Mabille and Sylvain Corlay                     *
+*                                                                          *
+* Distributed under the terms of the BSD 3-Clause License.                 *
+*                                                                          *
+* The full license is in the file LICENSE, distributed with this software. *
+****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "xproperty/xatomic_property.hpp"
+#include "xproperty/xdelta.hpp"
+#include "xproperty/xjournal.hpp"
+#include "xproperty/xobserved.hpp"
+#include "xproperty/xsnapshot.hpp"
+
+namespace
+{
+
+struct Vec : public xp::xobserved<Vec>
+{
+    XPROPERTY(double, Vec, x);
+    XPROPERTY(double, Vec, y);
+    XPROPERTY_GATED(double, Vec, z);
+};
+
+struct Label : public xp::xobserved<Label>
+{
+    XPROPERTY(std::string, Label, text);
+    XPROPERTY_GATED(int, Label, size);
+    XPROPERTY_ATOMIC(int, Label, count);
+};
+
+}
+
+TEST(xsnapshot, memcpy)
+{
+    static_assert(xp::detail::is_memcpy_snapshot<Vec>::value, "Vec is captured with a single memcpy");
+    static_assert(!xp::detail::is_memcpy_snapshot<Label>::value, "Label is captured property by property");
+
+    Vec v;
+    v.x = 1.0;
+    v.y = 2.0;
+    v.z = 3.0;
+    auto snap = xp::snapshot(v);
+
+    std::vector<double> old_x;
+    int observed = 0;
+    XOBSERVE(v, x, ([&old_x](const Vec&, const xp::change<double>& c) { old_x.push_back(c.old_value); }));
+    XOBSERVE(v, y, [&observed](const Vec& w) { observed += int(w.x); });
+    XOBSERVE(v, z, [&observed](const Vec&) { observed += 100; });
+
+    v.x = 4.0;
+    v.y = 5.0;
+    xp::restore(v, snap, false);
+    ASSERT_EQ(1.0, v.x);
+    ASSERT_EQ(2.0, v.y);
+    ASSERT_EQ(3.0, v.z);
+    ASSERT_EQ(std::vector<double>({ 1.0 }), old_x);
+    ASSERT_EQ(4, observed);
+
+    v.x = 6.0;
+    xp::restore(v, snap);
+    ASSERT_EQ(1.0, v.x);
+    ASSERT_EQ(std::vector<double>({ 1.0, 1.0, 6.0 }), old_x);
+    // The gated z is unchanged, y sees the restored x
+    ASSERT_EQ(5, observed);
+
+    // Callbacks are not captured
+    v.x = 7.0;
+    snap.capture(v);
+    Vec other;
+    xp::restore(other, snap);
+    ASSERT_EQ(7.0, other.x);
+}
+
+TEST(xsnapshot, generic)
+{
+    Label label;
+    label.text = "text";
+    label.size = 12;
+    label.count = 3;
+    auto snap = xp::snapshot(label);
+
+    std::vector<std::string> old_text;
+    int observed = 0;
+    XOBSERVE(label, text, ([&old_text](const Label&, const xp::change<std::string>& c) { old_text.push_back(c.old_value); }));
+    XOBSERVE(label, size, [&observed](const Label&) { ++observed; });
+    XVALIDATE(label, text, [](const Label&, std::string) { return std::string("validated"); });
+
+    label.text = "other";
+    label.count = 4;
+    xp::restore(label, snap);
+    ASSERT_EQ(std::string("text"), static_cast<const std::string&>(label.text));
+    ASSERT_EQ(3, label.count.load());
+    ASSERT_EQ(std::vector<std::string>({ "text", "validated" }), old_text);
+    ASSERT_EQ(0, observed);
+
+    label.size = 14;
+    xp::restore(label, snap, false);
+    ASSERT_EQ(12, label.size);
+    ASSERT_EQ(1, observed);
+}
+
+TEST(xsnapshot, restore_without_notification)
+{
+    // Restoring without notification still marks the properties as dirty and
+    // journals them, so that deltas and journals include the restored values.
+    Vec v;
+    v.x = 1.0;
+    v.y = 2.0;
+    auto vsnap = xp::snapshot(v);
+    xp::xjournal journal(16);
+    v.set_journal(&journal);
+    v.track_dirty();
+    v.y = 5.0;
+    v.clear_dirty();
+    xp::xjournal_entry e;
+    while (journal.pop(e))
+    {
+    }
+
+    xp::restore(v, vsnap, false);
+    ASSERT_FALSE(v.dirty<xoffsetof(Vec, x)>());
+    ASSERT_TRUE(v.dirty<xoffsetof(Vec, y)>());
+    ASSERT_TRUE(journal.pop(e));
+    ASSERT_EQ(xoffsetof(Vec, y), e.offset);
+    ASSERT_FALSE(journal.pop(e));
+
+    std::vector<char> buffer;
+    xp::encode_delta(v, buffer);
+    Vec target;
+    xp::decode_delta(target, buffer.data(), buffer.size());
+    ASSERT_EQ(0.0, target.x);
+    ASSERT_EQ(2.0, target.y);
+    v.set_journal(nullptr);
+
+    Label l;
+    l.text = "text";
+    auto lsnap = xp::snapshot(l);
+    l.track_dirty();
+    l.text = "modified";
+    l.clear_dirty();
+
+    xp::restore(l, lsnap, false);
+    ASSERT_TRUE(l.dirty<xoffsetof(Label, text)>());
+    ASSERT_FALSE(l.dirty<xoffsetof(Label, size)>());
+    buffer.clear();
+    xp::encode_delta(l, buffer);
+    Label ltarget;
+    xp::decode_delta(ltarget, buffer.data(), buffer.size());
+    ASSERT_EQ(std::string("text"), static_cast<const std::string&>(ltarget.text));
+}